@@ -0,0 +1,139 @@
+#!/bin/bash
+# Purpose: compare the transfer methods (-T) and the output modes (-O) of
+#          ntripserver on loopback
+#
+# Usage: ./benchmark.sh [-i file|tcp|pty] [-r MB/s] [-d Seconds]
+#                       [-T Method] [MegaBytes] [Port]
+#
+# A file of random data is sent through ntripserver to fakecaster for
+# each transfer method and output mode. Printed are the throughput seen
+# by the caster and the CPU time ntripserver used per MB. Methods which
+# are not compiled in (uring needs "make IO_URING=1") are skipped.
+#
+# Then the synthetic RTCM 3 source of fakecaster feeds ntripserver at a
+# fixed rate (-r, default 5 MB/s, for -d seconds, default 4) through a
+# fifo (-M 3), a TCP socket (-M 2) or a pseudo terminal (-M 1), chosen
+# with -i, for each of the output modes http, rtsp, ntrip1 and udp. For
+# each mode the sustained throughput, the CPU time per MB, the latency
+# from the source to the caster and the data lost on the way are printed.
+
+SRC=file
+RATE=5
+SEC=4
+METHOD=loop
+while getopts "i:r:d:T:" OPT; do
+  case $OPT in
+    i) SRC=$OPTARG ;;
+    r) RATE=$OPTARG ;;
+    d) SEC=$OPTARG ;;
+    T) METHOD=$OPTARG ;;
+    *) echo "Usage: $0 [-i file|tcp|pty] [-r MB/s] [-d Seconds]" \
+         "[-T Method] [MegaBytes] [Port]" >&2; exit 1 ;;
+  esac
+done
+shift $((OPTIND-1))
+case $SRC in
+  file|tcp|pty) ;;
+  *) echo "unknown source $SRC, use file, tcp or pty" >&2; exit 1 ;;
+esac
+
+MB=${1:-100}
+PORT=${2:-12101}
+BYTES=$((MB*1000000))
+TMP=$(mktemp -d /tmp/ntripbench.XXXXXX) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+[ -x ./ntripserver ] || make ntripserver || exit 1
+make -s fakecaster || exit 1
+head -c $BYTES /dev/urandom > $TMP/data
+
+# nanoseconds on the CPU of process $1, summed over all threads
+cputime()
+{
+  cat /proc/$1/task/*/schedstat 2>/dev/null | awk '{n+=$1} END {print n}'
+}
+
+printf "%-8s %-7s %10s %12s\n" method output "MB/s" "CPU ms/MB"
+for OUT in 3 1; do
+  for T in loop thread splice uring; do
+    ./fakecaster -p $PORT -n $BYTES > $TMP/caster 2>&1 & FC=$!
+    sleep 0.2
+    ./ntripserver -M 3 -s $TMP/data -O $OUT -a 127.0.0.1 -p $PORT \
+      -m BENCH -n user -c pass -T $T > $TMP/server 2>&1 & NS=$!
+    # ntripserver ends at once for methods which are not compiled in
+    while kill -0 $FC 2>/dev/null && kill -0 $NS 2>/dev/null; do
+      sleep 0.05
+    done
+    kill $FC 2>/dev/null; wait $FC 2>/dev/null
+    CPU=$(cputime $NS)
+    kill -INT $NS 2>/dev/null; wait $NS 2>/dev/null
+    if grep -q "unknown transfer method" $TMP/server; then
+      continue
+    fi
+    if grep -q "NOTE:" $TMP/server; then
+      T="$T*"
+    fi
+    MBS=$(awk '{print $6; exit}' $TMP/caster)
+    if [ -z "$CPU" ] || [ -z "$MBS" ]; then
+      printf "%-8s %-7s failed\n" $T $OUT
+      continue
+    fi
+    printf "%-8s %-7s %10s %12.2f\n" $T $OUT $MBS \
+      $(echo "$CPU $MB" | awk '{print $1/1e6/$2}')
+  done
+done
+echo "* = method not usable for this output, ran as -T loop"
+
+# synthetic RTCM 3 stream at a fixed rate
+SBYTES=$(echo "$RATE $SEC" | awk '{printf "%d", $1*$2*1e6}')
+echo
+echo "RTCM 3 source: $SRC, $RATE MB/s for $SEC s, -T $METHOD"
+printf "%-7s %8s %10s %9s %9s %9s %7s\n" output "MB/s" "CPU ms/MB" \
+  "p50 ms" "p99 ms" "max ms" "lost %"
+mkfifo $TMP/fifo || exit 1
+for OUT in http rtsp ntrip1 udp; do
+  ./fakecaster -p $PORT -n $SBYTES -k > $TMP/caster 2>&1 & FC=$!
+  case $SRC in
+    file)
+      ./fakecaster -g file:$TMP/fifo -n $SBYTES -r ${RATE}e6 -k \
+        > $TMP/source 2>&1 & GEN=$!
+      INPUT="-M 3 -s $TMP/fifo" ;;
+    tcp)
+      ./fakecaster -g tcp:$((PORT+1)) -n $SBYTES -r ${RATE}e6 -k \
+        > $TMP/source 2>&1 & GEN=$!
+      INPUT="-M 2 -H 127.0.0.1 -P $((PORT+1))" ;;
+    pty)
+      ./fakecaster -g pty -n $SBYTES -r ${RATE}e6 -k \
+        > $TMP/source 2>&1 & GEN=$!
+      while [ ! -s $TMP/source ] && kill -0 $GEN 2>/dev/null; do
+        sleep 0.05
+      done
+      INPUT="-M 1 -i $(head -1 $TMP/source) -b 115200" ;;
+  esac
+  sleep 0.2
+  ./ntripserver $INPUT -O $OUT -a 127.0.0.1 -p $PORT -m BENCH -n user \
+    -c pass -T $METHOD > $TMP/server 2>&1 & NS=$!
+  # the caster and the source stay open after the report (-k), so
+  # ntripserver is still there to be measured
+  while [ ! -s $TMP/caster ] && kill -0 $FC 2>/dev/null \
+    && kill -0 $NS 2>/dev/null; do
+    sleep 0.05
+  done
+  sleep 0.1
+  CPU=$(cputime $NS)
+  kill $FC 2>/dev/null; wait $FC 2>/dev/null
+  kill -INT $NS 2>/dev/null; wait $NS 2>/dev/null
+  kill $GEN 2>/dev/null; wait $GEN 2>/dev/null
+  MBS=$(awk '{print $6; exit}' $TMP/caster)
+  GOT=$(awk '{print $1; exit}' $TMP/caster)
+  if [ -z "$CPU" ] || [ -z "$MBS" ]; then
+    printf "%-7s failed\n" $OUT
+    continue
+  fi
+  # "latency of N frames: p50 X ms, p99 Y ms, max Z ms"
+  LAT=$(awk '/^latency/ {print $6, $9, $12}' $TMP/caster)
+  printf "%-7s %8s %10.2f %9s %9s %9s %7.2f\n" $OUT $MBS \
+    $(echo "$CPU $GOT" | awk '{print $2 ? $1/$2 : 0}') \
+    ${LAT:-- - -} $(echo "$GOT $SBYTES" | awk '{l = 100-100*$1/$2;
+    print (l > 0 ? l : 0)}')
+done
@@ -0,0 +1,983 @@
+/*
+ * fakecaster.c
+ *
+ * Minimal caster for benchmarking ntripserver on the loopback interface.
+ * It accepts one upload in any of the output modes of ntripserver:
+ * Ntrip-Version 1.0 (SOURCE), Ntrip-Version 2.0 HTTP (chunked POST),
+ * RTSP (SETUP/RECORD, data as RTP over UDP) and plain UDP (RTP packets
+ * to the caster port), acknowledges it and counts the received payload
+ * bytes. HTTP chunks and RTP headers are removed, so only the stream data
+ * itself is counted. When the expected number of bytes has arrived, the
+ * upload ends or no data came for the idle time, the throughput is
+ * printed to stdout and the program ends (with -k it keeps the connection
+ * until it is killed).
+ *
+ * With -g it is the synthetic RTCM 3 source for such a benchmark instead:
+ * it writes RTCM 3 frames of a proprietary message type, which carry the
+ * time they were generated, to a file or fifo, to the first client of a
+ * TCP port or to a pseudo terminal. The caster finds these frames in the
+ * upload and prints the end-to-end latency through ntripserver. A
+ * sequence number in the frames shows the data lost on the way.
+ *
+ * With -f the caster injects a fault into the upload after some seconds
+ * of data and takes the uploads which ntripserver makes to recover: a TCP
+ * reset, a stall of the reads, 401 replies, replies without Ntrip-Version
+ * header, SYNs which stay unanswered, a teardown of the RTSP session or
+ * lost RTP packets. It prints the time from the fault until the first
+ * frame arrived which the source wrote after it (after its end for the
+ * faults which last) and the source data lost.
+ *
+ * With -o the caster takes uploads with TCP Fast Open, the request may
+ * come with the SYN then.
+ *
+ * With -c the payload is also written to a capture file which
+ * ntripserver -t replays at the pace it arrived: "NTRIPCAP", then
+ * records of the milliseconds since the first payload (4 bytes) and the
+ * length (2 bytes), both big endian, followed by the data.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* posix_openpt(), cfmakeraw() */
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define BUFSZ 65536
+
+#define RTCM3_PREAMBLE 0xD3
+#define RTCM3_MAXLEN   (1023+6)
+#define BENCHTYPE      4001 /* proprietary message type of the source */
+#define GIVEUP         30   /* seconds to wait for the recovery */
+
+/* payload length of source frame n, see source() */
+static const int framelens[] = {430, 380, 290, 310, 20, 62, 137};
+#define FRAMELEN(n) (framelens[(n) % 7] + 6)
+
+/* HTTP chunk decoder, see dechunk() */
+struct chunkparser
+{
+  int           state;  /* 0 = size, 1 = size line end, 2 = data, 3 = CRLF */
+  unsigned long left;
+};
+
+/* RTCM 3 frame finder of the caster, see scan() */
+struct framescan
+{
+  unsigned char frame[RTCM3_MAXLEN];
+  int           have, need;
+  unsigned long frames, bad;
+  float        *lat;    /* latency of each source frame in microseconds */
+  unsigned long nlat, maxlat;
+  double        newest; /* generation time of the last source frame */
+  unsigned long next;   /* sequence number of the next source frame */
+  unsigned long lost, lostbytes, repeated;
+};
+
+static unsigned long crctable[256];
+static int fastopen; /* -o */
+static FILE *capture; /* -c */
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+} /* now */
+
+/* CRC-24Q of RTCM 3 */
+static void crc_init(void)
+{
+  unsigned long c;
+  int           i, j;
+
+  for(i = 0; i < 256; ++i)
+  {
+    c = (unsigned long)i << 16;
+    for(j = 0; j < 8; ++j)
+      c = (c & 0x800000) ? (c << 1) ^ 0x1864CFB : c << 1;
+    crctable[i] = c & 0xFFFFFF;
+  }
+} /* crc_init */
+
+static unsigned long crc24q(const unsigned char *buf, int len)
+{
+  unsigned long crc = 0;
+
+  while(len--)
+    crc = ((crc << 8) ^ crctable[((crc >> 16) ^ *buf++) & 0xFF]) & 0xFFFFFF;
+  return crc;
+} /* crc24q */
+
+/* returns the number of payload bytes in buf, -1 on a framing error */
+static long dechunk(struct chunkparser *p, const char *buf, long len)
+{
+  long i, payload = 0;
+
+  for(i = 0; i < len; ++i)
+  {
+    char c = buf[i];
+    switch(p->state)
+    {
+    case 0:
+      if(c >= '0' && c <= '9') p->left = p->left*16 + c-'0';
+      else if(c >= 'a' && c <= 'f') p->left = p->left*16 + c-'a'+10;
+      else if(c >= 'A' && c <= 'F') p->left = p->left*16 + c-'A'+10;
+      else if(c == '\r') p->state = 1;
+      else return -1;
+      break;
+    case 1:
+      if(c != '\n') return -1;
+      p->state = p->left ? 2 : 3;
+      break;
+    case 2:
+      {
+        long n = len-i < (long)p->left ? len-i : (long)p->left;
+        /* the payload is moved to the front for scan() */
+        memmove((char *)buf+payload, buf+i, n);
+        payload += n;
+        p->left -= n;
+        i += n-1;
+        if(!p->left) p->state = 3;
+      }
+      break;
+    case 3:
+      if(c == '\n') p->state = 0;
+      else if(c != '\r') return -1;
+      break;
+    }
+  }
+  return payload;
+} /* dechunk */
+
+/* Looks for RTCM 3 frames in the payload. Frames of the source type carry
+   their generation time in microseconds and a sequence number after the
+   message number. */
+static void scan(struct framescan *f, const unsigned char *buf, long len,
+double t)
+{
+  long i, n;
+
+  for(i = 0; i < len; i += n)
+  {
+    n = 1;
+    if(!f->have)
+    {
+      if(buf[i] != RTCM3_PREAMBLE)
+        continue;
+      f->need = 3;
+    }
+    else if(f->need > 3)
+      n = len-i < f->need-f->have ? len-i : f->need-f->have;
+    memcpy(f->frame+f->have, buf+i, n);
+    f->have += n;
+    if(f->have < f->need)
+      continue;
+    if(f->need == 3)
+    {
+      if(f->frame[1] & 0xFC)
+        f->have = 0;
+      else
+        f->need = (((f->frame[1] & 3) << 8) | f->frame[2]) + 6;
+      continue;
+    }
+    /* a frame cut by lost packets is dropped, the next one resyncs */
+    if(crc24q(f->frame, f->need-3) != (unsigned long)((f->frame[f->need-3]
+    << 16) | (f->frame[f->need-2] << 8) | f->frame[f->need-1]))
+      ++f->bad;
+    else
+    {
+      ++f->frames;
+      if(f->need >= 6+14 && ((f->frame[3] << 4) | (f->frame[4] >> 4))
+      == BENCHTYPE)
+      {
+        unsigned long long us = 0;
+        unsigned long      seq = 0;
+        int j;
+
+        for(j = 0; j < 8; ++j)
+          us = (us << 8) | f->frame[5+j];
+        for(j = 0; j < 4; ++j)
+          seq = (seq << 8) | f->frame[13+j];
+        /* frames before the first one which arrived don't count */
+        if(seq < f->next)
+          ++f->repeated;
+        for(; f->nlat && f->next < seq; ++f->next)
+        {
+          ++f->lost;
+          f->lostbytes += FRAMELEN(f->next);
+        }
+        if(seq >= f->next)
+          f->next = seq+1;
+        f->newest = us/1e6;
+        if(f->nlat == f->maxlat)
+        {
+          f->maxlat = f->maxlat ? f->maxlat*2 : 65536;
+          if(!(f->lat = realloc(f->lat, f->maxlat*sizeof(*f->lat))))
+          {
+            perror("ERROR: latency samples");
+            exit(1);
+          }
+        }
+        f->lat[f->nlat++] = t*1e6 - us;
+      }
+    }
+    f->have = 0;
+  }
+} /* scan */
+
+static int cmpfloat(const void *a, const void *b)
+{
+  float x = *(const float *)a, y = *(const float *)b;
+  return x < y ? -1 : x > y;
+} /* cmpfloat */
+
+static void latency(struct framescan *f)
+{
+  if(!f->nlat)
+    return;
+  qsort(f->lat, f->nlat, sizeof(*f->lat), cmpfloat);
+  printf("latency of %lu frames: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+  f->nlat, f->lat[f->nlat/2]/1e3, f->lat[f->nlat*99/100]/1e3,
+  f->lat[f->nlat-1]/1e3);
+  printf("lost %lu frames, %lu bytes, %lu repeated\n", f->lost, f->lostbytes,
+  f->repeated);
+} /* latency */
+
+/* writes all of buf, returns 0 on error */
+static int writeall(int fd, const unsigned char *buf, size_t len)
+{
+  ssize_t n;
+
+  while(len)
+  {
+    if((n = write(fd, buf, len)) < 0)
+    {
+      if(errno == EINTR)
+        continue;
+      return 0;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 1;
+} /* writeall */
+
+/********************************************************************
+ * synthetic RTCM 3 source                                          *
+ *                                                                  *
+ * The frames have payloads of the sizes of MSM7 observations, a    *
+ * station record and ephemerides. A rate of 0 writes as fast as    *
+ * the reader takes the data. Otherwise the frames are generated    *
+ * when they are due, so their time stamps are the time they were   *
+ * written, and like a receiver the source doesn't wait: frames     *
+ * which find the buffer full or nobody reading are lost. A reader  *
+ * which went away is looked for again.                             *
+ ********************************************************************/
+struct source
+{
+  const char *spec;
+  int         fd, listener, slave;
+};
+
+static int source_open(struct source *s)
+{
+  s->fd = s->listener = s->slave = -1;
+  if(!strncmp(s->spec, "file:", 5))
+  {
+    /* a fifo blocks here until ntripserver opens it */
+    if((s->fd = open(s->spec+5, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0)
+      perror("ERROR: can't open source file");
+  }
+  else if(!strncmp(s->spec, "tcp:", 4))
+  {
+    struct sockaddr_in addr;
+    int                on = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(atoi(s->spec+4));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if((s->listener = socket(AF_INET, SOCK_STREAM, 0)) < 0
+    || setsockopt(s->listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0
+    || bind(s->listener, (struct sockaddr *)&addr, sizeof(addr)) < 0
+    || listen(s->listener, 1) < 0)
+    {
+      perror("ERROR: can't listen");
+      return -1;
+    }
+    if((s->fd = accept(s->listener, 0, 0)) < 0)
+      perror("ERROR: accept failed");
+    fcntl(s->listener, F_SETFL, O_NONBLOCK);
+  }
+  else if(!strcmp(s->spec, "pty"))
+  {
+    struct termios t;
+    const char    *name;
+
+    if((s->fd = posix_openpt(O_RDWR|O_NOCTTY)) < 0 || grantpt(s->fd) < 0
+    || unlockpt(s->fd) < 0 || !(name = ptsname(s->fd)))
+    {
+      perror("ERROR: can't open pseudo terminal");
+      return -1;
+    }
+    /* the slave stays open and raw, so nothing is echoed or converted
+       before ntripserver sets its own attributes */
+    if((s->slave = open(name, O_RDWR|O_NOCTTY)) < 0
+    || tcgetattr(s->slave, &t) < 0)
+    {
+      perror("ERROR: can't open pseudo terminal");
+      return -1;
+    }
+    cfmakeraw(&t);
+    tcsetattr(s->slave, TCSANOW, &t);
+    printf("%s\n", name);
+    fflush(stdout);
+    /* nobody tells when ntripserver opened the terminal, written data
+       would wait in it until then */
+    sleep(1);
+  }
+  else
+    fprintf(stderr, "ERROR: unknown source %s\n", s->spec);
+  if(s->fd >= 0)
+    fcntl(s->fd, F_SETFL, O_NONBLOCK);
+  return s->fd;
+} /* source_open */
+
+/* looks for a new reader without waiting, returns the descriptor or -1 */
+static int source_reopen(struct source *s)
+{
+  if(s->listener >= 0)
+    s->fd = accept(s->listener, 0, 0);
+  else if(!strncmp(s->spec, "file:", 5))
+    s->fd = open(s->spec+5, O_WRONLY|O_NONBLOCK); /* ENXIO without reader */
+  if(s->fd >= 0)
+    fcntl(s->fd, F_SETFL, O_NONBLOCK);
+  return s->fd;
+} /* source_reopen */
+
+static int source(const char *spec, double rate, unsigned long total,
+int keep)
+{
+  static unsigned char buf[BUFSZ];
+  unsigned long        gen = 0, sent = 0, dropped = 0, seq = 0;
+  size_t               off = 0, len = 0;
+  double               start;
+  struct source        s;
+  int                  i;
+
+  signal(SIGPIPE, SIG_IGN);
+  s.spec = spec;
+  if(source_open(&s) < 0)
+    return 1;
+  start = now();
+  srand(1);
+  while(gen < total || len > off)
+  {
+    double             t = now();
+    unsigned long long us = t*1e6;
+    unsigned long      due = rate > 0 ? (t-start)*rate : total;
+    struct pollfd      pfd;
+    ssize_t            w = 0;
+
+    if(due > total)
+      due = total;
+    if(off && len+RTCM3_MAXLEN > sizeof(buf))
+    {
+      memmove(buf, buf+off, len-off);
+      len -= off;
+      off = 0;
+    }
+    while(gen < due)
+    {
+      unsigned char *f = buf+len;
+      int            n = FRAMELEN(seq)-6;
+      unsigned long  crc;
+
+      if(len+n+6 > sizeof(buf))
+      {
+        if(rate <= 0)
+          break;
+        dropped += n+6;
+      }
+      else
+      {
+        f[0] = RTCM3_PREAMBLE;
+        f[1] = n >> 8;
+        f[2] = n;
+        f[3] = BENCHTYPE >> 4;
+        f[4] = (BENCHTYPE & 15) << 4;
+        for(i = 0; i < 8; ++i)
+          f[5+i] = us >> (56-8*i);
+        for(i = 0; i < 4; ++i)
+          f[13+i] = seq >> (24-8*i);
+        for(i = 14; i < n; ++i)
+          f[3+i] = rand();
+        crc = crc24q(f, n+3);
+        f[n+3] = crc >> 16;
+        f[n+4] = crc >> 8;
+        f[n+5] = crc;
+        len += n+6;
+      }
+      gen += n+6;
+      ++seq;
+    }
+    if(s.fd < 0 && source_reopen(&s) < 0)
+    {
+      dropped += len-off;
+      off = len = 0;
+    }
+    else if(len > off && (w = write(s.fd, buf+off, len-off)) > 0)
+    {
+      off += w;
+      sent += w;
+      if(off == len)
+        off = len = 0;
+    }
+    else if(w < 0 && errno != EAGAIN && errno != EINTR)
+    {
+      /* the reader went away, a started frame is lost with the rest */
+      close(s.fd);
+      s.fd = -1;
+      dropped += len-off;
+      off = len = 0;
+    }
+    if(w <= 0)
+    {
+      /* wait for the reader or the next frame */
+      pfd.fd = s.fd;
+      pfd.events = POLLOUT;
+      poll(&pfd, s.fd >= 0 && len > off, rate > 0 ? 1 : 100);
+    }
+  }
+  printf("source: %lu bytes in %.3f s, %lu dropped\n", sent, now()-start,
+  dropped);
+  fflush(stdout);
+  /* with -k the input stays open, as ntripserver ends with a closed
+     socket, a pty is kept until ntripserver read it all */
+  if(keep)
+    pause();
+  else if(s.slave >= 0)
+    sleep(5);
+  close(s.fd);
+  return 0;
+} /* source */
+
+/********************************************************************
+ * caster                                                           *
+ ********************************************************************/
+enum FAULT { NOFAULT, RST, STALL, AUTH, NOVERSION, SLOWSYN, TEARDOWN,
+UDPLOSS };
+static const char *faultnames[] = {"", "rst", "stall", "401", "nover",
+"slowsyn", "teardown", "udploss", 0};
+
+struct fault
+{
+  enum FAULT kind;
+  double     after;    /* seconds of data before the fault */
+  double     duration; /* of stall, 401, nover, slowsyn and udploss */
+  int        loss;     /* percent of the RTP packets udploss drops */
+  double     at, end;  /* time of the fault, 0 before */
+  double     recover;  /* seconds from the fault to the first frame the
+                          source wrote after its end, -1 before */
+};
+
+static void rtp_header(unsigned char *h, int pt, unsigned int ssrc)
+{
+  memset(h, 0, 12);
+  h[0] = 2 << 6;
+  h[1] = pt;
+  h[8] = ssrc >> 24;
+  h[9] = ssrc >> 16;
+  h[10] = ssrc >> 8;
+  h[11] = ssrc;
+} /* rtp_header */
+
+/* answers the RTSP requests of the control connection, returns -1 on a
+   bad request, 1 after TEARDOWN, otherwise 0 */
+static int rtsp(int sock, char *req, int port, unsigned int session,
+int refuse)
+{
+  char  reply[512], *cseq = strstr(req, "CSeq:"), *cp;
+  int   n, c = cseq ? atoi(cseq+5) : 0;
+
+  if(refuse)
+    n = snprintf(reply, sizeof(reply), "RTSP/1.0 401 Unauthorized\r\n"
+    "CSeq: %d\r\n\r\n", c);
+  else if(!strncmp(req, "SETUP ", 6))
+  {
+    if(!(cp = strstr(req, "client_port=")))
+      return -1;
+    /* ntripserver expects the session and the port as the 7th and 11th
+       token */
+    n = snprintf(reply, sizeof(reply), "RTSP/1.0 200 OK\r\nCSeq: %d\r\n"
+    "Session: %u\r\nTransport: RTP/GNSS;unicast;client_port=%d;"
+    "server_port=%d\r\n\r\n", c, session, atoi(cp+12), port);
+  }
+  else if(!strncmp(req, "RECORD ", 7) || !strncmp(req, "GET_PARAMETER ", 14)
+  || !strncmp(req, "TEARDOWN ", 9))
+  {
+    n = snprintf(reply, sizeof(reply), "RTSP/1.0 200 OK\r\nCSeq: %d\r\n"
+    "Session: %u\r\n\r\n", c, session);
+  }
+  else
+    return -1;
+  if(!writeall(sock, (unsigned char *)reply, n))
+    return -1;
+  return !strncmp(req, "TEARDOWN ", 9);
+} /* rtsp */
+
+/* writes payload which arrived at time t to the capture file */
+static void record(const unsigned char *buf, long n, double t)
+{
+  static double start = -1;
+  unsigned char hdr[6];
+  unsigned long ms;
+  long          len;
+
+  if(start < 0)
+    start = t;
+  ms = (unsigned long)((t - start) * 1000);
+  for(; n > 0; buf += len, n -= len)
+  {
+    len = n > 65535 ? 65535 : n;
+    hdr[0] = (unsigned char)(ms >> 24);
+    hdr[1] = (unsigned char)(ms >> 16);
+    hdr[2] = (unsigned char)(ms >> 8);
+    hdr[3] = (unsigned char)ms;
+    hdr[4] = (unsigned char)(len >> 8);
+    hdr[5] = (unsigned char)len;
+    fwrite(hdr, 1, sizeof(hdr), capture);
+    fwrite(buf, 1, (size_t)len, capture);
+  }
+} /* record */
+
+/* counts and scans payload which arrived at time t */
+static void payload(struct framescan *f, struct fault *fault,
+const unsigned char *buf, long n, double t)
+{
+  if(capture && n > 0)
+    record(buf, n, t);
+  scan(f, buf, n, t);
+  if(fault->at && fault->recover < 0 && f->newest >= fault->end)
+    fault->recover = t - fault->at;
+} /* payload */
+
+static int caster(int port, unsigned long expect, double idle, int keep,
+struct fault *fault)
+{
+  enum { NONE, NTRIP1, HTTP, RTSP, UDP } mode = NONE;
+  int                ls, us, sock = -1, dummy = -1, on = 1, hlen = 0;
+  int                done = 0, first = 1;
+  unsigned int       session = 12345;
+  unsigned short     seq = 0;
+  unsigned long      total = 0, packets = 0, lost = 0;
+  double             start = 0, end = 0, alive = 0;
+  struct sockaddr_in addr, peer;
+  socklen_t          plen = 0;
+  struct chunkparser chunk;
+  struct framescan   frames;
+  static char        buf[BUFSZ];
+  long               n;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  /* TCP for the uploads and RTSP control, UDP for RTP on the same port */
+  if((ls = socket(AF_INET, SOCK_STREAM, 0)) < 0
+  || setsockopt(ls, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0
+  || bind(ls, (struct sockaddr *)&addr, sizeof(addr)) < 0
+  || listen(ls, 1) < 0
+#ifdef TCP_FASTOPEN
+  || (fastopen && setsockopt(ls, IPPROTO_TCP, TCP_FASTOPEN, &on, sizeof(on))
+  < 0)
+#endif
+  || (us = socket(AF_INET, SOCK_DGRAM, 0)) < 0
+  || bind(us, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+  {
+    perror("ERROR: can't listen");
+    return 1;
+  }
+  n = 4*1024*1024;
+  setsockopt(us, SOL_SOCKET, SO_RCVBUF, &n, sizeof(n));
+  memset(&chunk, 0, sizeof(chunk));
+  memset(&frames, 0, sizeof(frames));
+  fault->recover = -1;
+
+  while(!done && !(expect && total >= expect))
+  {
+    struct pollfd pfd[2];
+    double        t = now();
+    int           infault, timeout = -1, i;
+
+    /*** the fault ***/
+    if(fault->kind && start && !fault->at && t >= start+fault->after)
+    {
+      fault->at = t;
+      fault->end = t + (fault->kind == RST || fault->kind == TEARDOWN ? 0
+      : fault->duration);
+      if(fault->kind != STALL && fault->kind != UDPLOSS)
+      {
+        /* the upload ends, RTSP and UDP sessions become unknown */
+        if(mode == UDP)
+        {
+          rtp_header((unsigned char *)buf, 98, session);
+          sendto(us, buf, 12, 0, (struct sockaddr *)&peer, plen);
+        }
+        else if(sock >= 0)
+        {
+          struct linger l = {1, 0};
+          if(fault->kind == RST)
+            setsockopt(sock, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+          close(sock);
+          sock = -1;
+        }
+        ++session;
+        mode = NONE;
+      }
+      if(fault->kind == SLOWSYN)
+      {
+        /* a connection nobody accepts fills the queue, further SYNs are
+           dropped and sent again by the client with growing delays */
+        if(listen(ls, 0) < 0 || (dummy = socket(AF_INET, SOCK_STREAM, 0)) < 0
+        || connect(dummy, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+          perror("ERROR: slowsyn");
+          return 1;
+        }
+      }
+    }
+    infault = fault->at && t < fault->end;
+    if(dummy >= 0 && !infault)
+    {
+      close(accept(ls, 0, 0));
+      close(dummy);
+      dummy = -1;
+      listen(ls, 1);
+    }
+    if(fault->kind)
+    {
+      /* after the recovery some more data shows the loss */
+      if(fault->recover >= 0 ? t >= fault->at+fault->recover+idle
+      : fault->at && t >= fault->end+GIVEUP)
+        break;
+      timeout = 100;
+    }
+    else if(start)
+    {
+      if(t-end >= idle)
+        break;
+      timeout = (idle-(t-end))*1000+1;
+    }
+
+    pfd[0].fd = sock < 0 ? ls : sock;
+    pfd[0].events = (sock < 0 && dummy >= 0) || (sock >= 0 && infault
+    && fault->kind == STALL) ? 0 : POLLIN;
+    pfd[1].fd = us;
+    pfd[1].events = POLLIN;
+    if((i = poll(pfd, 2, timeout)) < 0)
+    {
+      if(errno == EINTR)
+        continue;
+      perror("ERROR: poll failed");
+      return 1;
+    }
+    t = now();
+
+    if((pfd[0].revents & POLLIN) && sock < 0)
+    {
+      if((sock = accept(ls, 0, 0)) < 0)
+      {
+        perror("ERROR: accept failed");
+        return 1;
+      }
+      hlen = 0;
+    }
+    else if(pfd[0].revents)
+    {
+      if((n = read(sock, buf+hlen, sizeof(buf)-1-hlen)) <= 0)
+      {
+        if(n < 0 && errno == EINTR)
+          continue;
+        if(fault->kind)
+        {
+          /* ntripserver comes again */
+          close(sock);
+          sock = -1;
+          if(mode == RTSP)
+            ++session;
+          mode = NONE;
+          continue;
+        }
+        if(mode != NONE)
+          break;
+        fprintf(stderr, "ERROR: incomplete request\n");
+        return 1;
+      }
+      if(mode == NTRIP1 || mode == HTTP)
+      {
+        if(!start) start = t;
+        if(mode == HTTP && (n = dechunk(&chunk, buf, n)) < 0)
+        {
+          fprintf(stderr, "ERROR: broken chunk framing after %lu bytes\n",
+          total);
+          return 1;
+        }
+        total += n;
+        end = t;
+        payload(&frames, fault, (unsigned char *)buf, n, t);
+        continue;
+      }
+      /* request header, the payload may follow in the same read */
+      hlen += n;
+      buf[hlen] = 0;
+      while(sock >= 0 && hlen && (mode == NONE || mode == RTSP))
+      {
+        char *hend = strstr(buf, "\r\n\r\n");
+        if(!hend)
+        {
+          if(hlen >= (int)sizeof(buf)-1)
+          {
+            fprintf(stderr, "ERROR: request too long\n");
+            return 1;
+          }
+          break;
+        }
+        hend += 4;
+        if(mode == NONE && !strncmp(buf, "SETUP ", 6))
+        {
+          mode = RTSP;
+          first = 1;
+          frames.have = 0;
+        }
+        if(mode == RTSP)
+        {
+          if((i = rtsp(sock, buf, port, session, infault
+          && fault->kind == AUTH)) < 0)
+          {
+            fprintf(stderr, "ERROR: unsupported RTSP request\n");
+            return 1;
+          }
+          done = i && !fault->kind;
+        }
+        else
+        {
+          int         http = !strncmp(buf, "POST ", 5);
+          const char *reply = http ? "HTTP/1.1 200 OK\r\n\r\n"
+                                   : "ICY 200 OK\r\n\r\n";
+          if(!http && strncmp(buf, "SOURCE ", 7))
+          {
+            fprintf(stderr, "ERROR: unsupported request\n");
+            return 1;
+          }
+          if(infault && fault->kind == AUTH)
+            reply = http ? "HTTP/1.1 401 Unauthorized\r\n"
+            "Ntrip-Version: Ntrip/2.0\r\n\r\n" : "ERROR - Bad Password\r\n";
+          else if(infault && fault->kind == NOVERSION && http)
+            reply = "HTTP/1.1 400 Bad Request\r\n\r\n"; /* a 1.0 caster */
+          else
+          {
+            mode = http ? HTTP : NTRIP1;
+            memset(&chunk, 0, sizeof(chunk));
+            frames.have = 0;
+          }
+          if(!writeall(sock, (unsigned char *)reply, strlen(reply))
+          || mode == NONE)
+          {
+            close(sock);
+            sock = -1;
+            break;
+          }
+        }
+        hlen = buf+hlen-hend;
+        memmove(buf, hend, hlen+1);
+      }
+      if(sock >= 0 && hlen && (mode == NTRIP1 || mode == HTTP))
+      {
+        if(!start) start = t;
+        if(mode == HTTP && (hlen = dechunk(&chunk, buf, hlen)) < 0)
+          return 1;
+        total += hlen;
+        end = t;
+        payload(&frames, fault, (unsigned char *)buf, hlen, t);
+        hlen = 0;
+      }
+    }
+
+    if(pfd[1].revents & POLLIN)
+    {
+      unsigned char *p = (unsigned char *)buf;
+
+      plen = sizeof(peer);
+      if((n = recvfrom(us, buf, sizeof(buf)-1, 0, (struct sockaddr *)&peer,
+      &plen)) < 12 || p[0] != (2 << 6))
+        continue;
+      if((p[1] & 0x7F) == 97 && mode == NONE)
+      {
+        /* plain UDP: the HTTP request comes in an RTP packet */
+        buf[n] = 0;
+        if(strncmp(buf+12, "POST ", 5))
+        {
+          fprintf(stderr, "ERROR: unsupported request\n");
+          return 1;
+        }
+        rtp_header(p, 97, session);
+        if(infault && fault->kind == AUTH)
+          n = 12 + sprintf(buf+12, "HTTP/1.1 401 Unauthorized\r\n"
+          "Ntrip-Version: Ntrip/2.0\r\n\r\n");
+        else
+        {
+          n = 12 + sprintf(buf+12, "HTTP/1.1 200 OK\r\nSession: %u\r\n\r\n",
+          session);
+          mode = UDP;
+          first = 1;
+          frames.have = 0;
+        }
+        sendto(us, buf, n, 0, (struct sockaddr *)&peer, plen);
+        alive = t;
+      }
+      else if((p[1] & 0x7F) == 98 && mode == UDP)
+      {
+        /* end of the UDP session */
+        if(!fault->kind)
+          break;
+        ++session;
+        mode = NONE;
+      }
+      else if((p[1] & 0x7F) == 96 && (mode == UDP || mode == RTSP)
+      && session == (unsigned int)((p[8] << 24) | (p[9] << 16)
+      | (p[10] << 8) | p[11]))
+      {
+        unsigned short s = (p[2] << 8) | p[3];
+
+        if(infault && fault->kind == UDPLOSS && rand() % 100 < fault->loss)
+          continue;
+        if(!first && s != seq)
+          lost += (unsigned short)(s-seq);
+        first = 0;
+        seq = s+1;
+        ++packets;
+        if(!start) start = t;
+        total += n-12;
+        end = t;
+        payload(&frames, fault, p+12, n-12, t);
+        if(mode == UDP && t-alive > 20)
+        {
+          /* keepalive, ntripserver gives up after 60 s without */
+          rtp_header(p, 96, session);
+          sendto(us, buf, 12, 0, (struct sockaddr *)&peer, plen);
+          alive = t;
+        }
+      }
+    }
+  }
+  if(!end) end = now();
+  if(!start) start = end;
+  printf("%lu bytes in %.3f s, %.1f MB/s\n", total, end-start,
+  end > start ? total/(end-start)/1e6 : 0.0);
+  latency(&frames);
+  if(frames.bad)
+    printf("%lu broken RTCM 3 frames\n", frames.bad);
+  if(packets)
+    printf("%lu RTP packets, %lu lost\n", packets, lost);
+  if(fault->kind && !fault->at)
+    printf("fault %s: not injected\n", faultnames[fault->kind]);
+  else if(fault->kind && fault->recover < 0)
+    printf("fault %s: not recovered after %.3f s\n", faultnames[fault->kind],
+    now()-fault->at);
+  else if(fault->kind)
+    printf("fault %s: recovered after %.3f s\n", faultnames[fault->kind],
+    fault->recover);
+  if(keep)
+  {
+    /* ntripserver would end with the connection, but its CPU time is
+       still to be read */
+    fflush(stdout);
+    if(capture)
+      fflush(capture);
+    pause();
+  }
+  return expect && total < expect;
+} /* caster */
+
+int main(int argc, char **argv)
+{
+  int           port = 2101, keep = 0, c;
+  unsigned long expect = 0;
+  double        idle = 2, rate = 0;
+  const char   *gen = 0;
+  struct fault  fault;
+
+  memset(&fault, 0, sizeof(fault));
+  fault.after = 2;
+  fault.duration = 5;
+  fault.loss = 20;
+  while((c = getopt(argc, argv, "p:n:t:kg:r:f:a:d:l:oc:")) != EOF)
+  {
+    switch(c)
+    {
+    case 'p': port = atoi(optarg); break;
+    case 'n': expect = strtoul(optarg, 0, 10); break;
+    case 't': idle = atof(optarg); break;
+    case 'k': keep = 1; break;
+    case 'g': gen = optarg; break;
+    case 'r': rate = atof(optarg); break;
+    case 'f':
+      for(c = 1; faultnames[c] && strcmp(faultnames[c], optarg); ++c)
+        ;
+      if(!faultnames[c])
+      {
+        fprintf(stderr, "ERROR: unknown fault %s\n", optarg);
+        return 1;
+      }
+      fault.kind = c;
+      break;
+    case 'a': fault.after = atof(optarg); break;
+    case 'd': fault.duration = atof(optarg); break;
+    case 'l': fault.loss = atoi(optarg); break;
+    case 'o': fastopen = 1; break;
+    case 'c':
+      if(!(capture = fopen(optarg, "wb")))
+      {
+        fprintf(stderr, "ERROR: can't create %s: %s\n", optarg,
+        strerror(errno));
+        return 1;
+      }
+      fputs("NTRIPCAP", capture);
+      break;
+    default:
+      fprintf(stderr,
+      "Usage: %s [-p Port] [-n ExpectedBytes] [-t IdleSeconds] [-k] [-o]\n"
+      "       [-c CaptureFile]\n"
+      "       [-f rst|stall|401|nover|slowsyn|teardown|udploss [-a After]\n"
+      "       [-d Duration] [-l LossPercent]]\n"
+      "       %s -g file:Path|tcp:Port|pty -n Bytes [-r BytesPerSecond] [-k]\n",
+      argv[0], argv[0]);
+      return 1;
+    }
+  }
+  crc_init();
+  if(gen)
+    return source(gen, rate, expect ? expect : 100000000UL, keep);
+  return caster(port, expect, idle, keep, &fault);
+} /* main */
@@ -0,0 +1,111 @@
+#!/bin/bash
+# Purpose: measure how ntripserver recovers from faults of the caster
+#
+# Usage: ./faultbench.sh [-i file|tcp|pty] [-r kB/s] [-d Seconds]
+#                        [-R MaxDelay] [-T Method] [-Q QueueSize]
+#                        [-p Port] [Fault:Output ...]
+#
+# The synthetic RTCM 3 source of fakecaster feeds ntripserver (-R, default
+# 4) at a fixed rate (-r, default 100 kB/s) through a fifo, a TCP socket
+# or a pseudo terminal (-i, default tcp). After 2 seconds of data
+# fakecaster injects the fault into the upload, the lasting ones for -d
+# seconds (default 4):
+#
+#   rst       TCP reset of the upload
+#   stall     the caster doesn't read
+#   401       the upload ends and new ones are refused with 401
+#   nover     the upload ends and POSTs are answered without
+#             Ntrip-Version header, like a Ntrip 1.0 caster does
+#   slowsyn   the upload ends and SYNs stay unanswered
+#   teardown  the caster ends the RTSP session
+#   udploss   20% of the RTP packets are lost
+#
+# Printed are the seconds from the fault until the first frame arrived
+# which the source wrote after it (after its end for the lasting faults),
+# the source data lost on the way and the reconnects of ntripserver,
+# "ended" if ntripserver gave up. The data which ntripserver keeps while
+# reconnecting is limited by its queue size (-Q, default 65536).
+
+SRC=tcp
+RATE=100
+DUR=4
+MAXDELAY=4
+METHOD=loop
+QUEUE=65536
+PORT=12101
+while getopts "i:r:d:R:T:Q:p:" OPT; do
+  case $OPT in
+    i) SRC=$OPTARG ;;
+    r) RATE=$OPTARG ;;
+    d) DUR=$OPTARG ;;
+    R) MAXDELAY=$OPTARG ;;
+    T) METHOD=$OPTARG ;;
+    Q) QUEUE=$OPTARG ;;
+    p) PORT=$OPTARG ;;
+    *) echo "Usage: $0 [-i file|tcp|pty] [-r kB/s] [-d Seconds]" \
+         "[-R MaxDelay] [-T Method] [-Q QueueSize] [-p Port]" \
+         "[Fault:Output ...]" >&2
+       exit 1 ;;
+  esac
+done
+shift $((OPTIND-1))
+case $SRC in
+  file|tcp|pty) ;;
+  *) echo "unknown source $SRC, use file, tcp or pty" >&2; exit 1 ;;
+esac
+CASES=${*:-rst:http rst:ntrip1 rst:rtsp stall:http 401:http 401:ntrip1 \
+nover:http slowsyn:http teardown:rtsp udploss:rtsp udploss:udp}
+
+TMP=$(mktemp -d /tmp/ntripfault.XXXXXX) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+[ -x ./ntripserver ] || make ntripserver || exit 1
+make -s fakecaster || exit 1
+mkfifo $TMP/fifo || exit 1
+
+echo "RTCM 3 source: $SRC, $RATE kB/s, -T $METHOD -R $MAXDELAY -Q $QUEUE"
+printf "%-9s %-7s %10s %11s %8s %10s\n" fault output "recover s" \
+  "lost bytes" "frames" reconnects
+for CASE in $CASES; do
+  FAULT=${CASE%:*}
+  OUT=${CASE#*:}
+  ./fakecaster -p $PORT -f $FAULT -d $DUR -k > $TMP/caster 2>&1 & FC=$!
+  case $SRC in
+    file)
+      ./fakecaster -g file:$TMP/fifo -r ${RATE}e3 -k \
+        > $TMP/source 2>&1 & GEN=$!
+      INPUT="-M 3 -s $TMP/fifo" ;;
+    tcp)
+      ./fakecaster -g tcp:$((PORT+1)) -r ${RATE}e3 -k \
+        > $TMP/source 2>&1 & GEN=$!
+      INPUT="-M 2 -H 127.0.0.1 -P $((PORT+1))" ;;
+    pty)
+      ./fakecaster -g pty -r ${RATE}e3 -k > $TMP/source 2>&1 & GEN=$!
+      while [ ! -s $TMP/source ] && kill -0 $GEN 2>/dev/null; do
+        sleep 0.05
+      done
+      INPUT="-M 1 -i $(head -1 $TMP/source) -b 115200" ;;
+  esac
+  sleep 0.2
+  ./ntripserver $INPUT -O $OUT -a 127.0.0.1 -p $PORT -m BENCH -n user \
+    -c pass -T $METHOD -R $MAXDELAY -Q $QUEUE > $TMP/server 2>&1 & NS=$!
+  # fakecaster reports after the recovery or when it gave up
+  while [ ! -s $TMP/caster ] && kill -0 $FC 2>/dev/null \
+    && kill -0 $NS 2>/dev/null; do
+    sleep 0.1
+  done
+  sleep 0.1
+  RECONNECTS=$(grep -c "reconnect in" $TMP/server)
+  kill -0 $NS 2>/dev/null || ENDED=1
+  kill -INT $NS 2>/dev/null; wait $NS 2>/dev/null
+  kill $FC $GEN 2>/dev/null; wait $FC $GEN 2>/dev/null
+  # "fault F: recovered after X s" and "lost N frames, B bytes, R repeated"
+  REC=$(awk '/^fault/ {print $3 == "recovered" ? $5 : "never"}' $TMP/caster)
+  LOST=$(awk '/^lost/ {print $4, $2}' $TMP/caster)
+  if [ -z "$REC" ] && [ -n "$ENDED" ]; then
+    REC=ended # ntripserver gave up
+  fi
+  printf "%-9s %-7s %10s %11s %8s %10s\n" $FAULT $OUT ${REC:-failed} \
+    ${LOST:-- -} $RECONNECTS
+  ENDED=
+done
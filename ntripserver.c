@@ -39,10 +39,15 @@
 static char revisionstr[] = "$Revision: 1.51 $";
 static char datestr[]     = "$Date: 2010/01/22 08:36:59 $";
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* sendmmsg(), splice() */
+#endif
+
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -54,6 +59,7 @@ static char datestr[]     = "$Date: 2010/01/22 08:36:59 $";
 
 #ifdef WINDOWSVERSION
   #include <winsock2.h>
+  #include <ws2tcpip.h>
   #include <io.h>
   #include <sys/stat.h>
   #include <windows.h>
@@ -61,11 +67,18 @@ static char datestr[]     = "$Date: 2010/01/22 08:36:59 $";
   typedef u_long in_addr_t;
   typedef size_t socklen_t;
   typedef u_short uint16_t;
+  struct iovec { void *iov_base; size_t iov_len; };
 #else
   typedef int sockettype;
   #include <arpa/inet.h>
+  #include <sys/ioctl.h>
   #include <sys/socket.h>
+  #include <sys/stat.h>
+  #include <sys/uio.h>
+  #include <poll.h>
+  #include <pthread.h>
   #include <netinet/in.h>
+  #include <netinet/tcp.h>
   #include <netdb.h>
   #include <sys/termios.h>
   #define closesocket(sock) close(sock)
@@ -73,6 +86,21 @@ static char datestr[]     = "$Date: 2010/01/22 08:36:59 $";
   #define INVALID_SOCKET -1
 #endif
 
+#if defined(__linux__) && !defined(WINDOWSVERSION)
+  #include <sys/epoll.h>
+  #include <linux/sockios.h>
+  #define HAVE_EPOLL
+  #define HAVE_SENDMMSG
+  #define HAVE_SPLICE
+  #ifdef IO_URING
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+  #endif
+#elif defined(IO_URING)
+  #error "IO_URING is only available for Linux"
+#endif
+
 #ifndef COMPILEDATE
 #define COMPILEDATE " built " __DATE__
 #endif
@@ -85,12 +113,26 @@ static char datestr[]     = "$Date: 2010/01/22 08:36:59 $";
 #ifndef O_EXLOCK
 #define O_EXLOCK 0 /* prevent compiler errors */
 #endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 /* prevent compiler errors */
+#endif
 
 enum MODE { SERIAL = 1, TCPSOCKET = 2, INFILE = 3, SISNET = 4, UDPSOCKET = 5,
 CASTER = 6, LAST };
 
 enum OUTMODE { HTTP = 1, RTSP = 2, NTRIP1 = 3, UDP = 4, END };
 
+enum TRANSFER { LOOP = 1, THREAD, SPLICE, URING };
+
+enum RTCMMODE { RTCM_NONE = 0, RTCM_CHECK, RTCM_ALIGN };
+
+#define RTPBATCH        16  /* RTP packets sent with one system call */
+
+/* events reported by wait_events() */
+#define WAIT_IN         1   /* input or input queue readable */
+#define WAIT_OUT        2   /* caster socket writable */
+#define WAIT_CTL        4   /* RTSP/UDP control socket readable */
+
 #define AGENTSTRING     "NTRIP NtripServerPOSIX"
 #define BUFSZ           1024
 #define SZ              64
@@ -109,6 +151,9 @@ enum OUTMODE { HTTP = 1, RTSP = 2, NTRIP1 = 3, UDP = 4, END };
 #define RTP_VERSION     2
 #define TIME_RESOLUTION 125
 
+#define QUEUESZ         65536
+#define NOTSENTLOWAT    4096 /* unsent bytes the kernel takes with -w */
+
 static int ttybaud             = 19200;
 #ifndef WINDOWSVERSION
 static const char *ttyport     = "/dev/gps";
@@ -136,25 +181,368 @@ static char rtsp_extension[SZ] = "";
 static const char * mountpoint = NULL;
 static int udp_cseq            = 1;
 static int udp_tim, udp_seq, udp_init;
+static enum TRANSFER transfer  = LOOP;
+static size_t queuesize        = QUEUESZ;
+static int backlogage          = 10; /* seconds, see backlog_trim() */
+static enum RTCMMODE rtcmmode  = RTCM_NONE;
+static int fastopen;              /* -o, TCP Fast Open to the caster */
+static int deadtime = 10;         /* -k, seconds, see caster_sockopts() */
+static int nagle;                 /* -g */
+static int maxage;                /* -w, milliseconds, see backlog_expire() */
+static int regularfile;           /* -s is no fifo or device, it doesn't age */
+#ifndef WINDOWSVERSION
+static const char *metricsaddr = NULL;
+#endif
+#ifndef WINDOWSVERSION
+static int sigusr1_received    = 0;
+#endif
+
+/* ingress to wire latency of the queued bytes, see lat_in() */
+#define LATMARKS   1024         /* reads in flight in one queue */
+#define LATSUB     5            /* 2^LATSUB buckets per power of 2 */
+#define LATBUCKETS (28 << LATSUB) /* up to 2^32 microseconds */
+
+struct latmark
+{
+  size_t    end;      /* ring head after the read was published */
+  long long usec;     /* when it was published */
+};
+
+struct latency
+{
+  struct latmark     mark[LATMARKS];
+  size_t             markhead;     /* written by the producer */
+  size_t             marktail;     /* written by the consumer */
+  size_t             lastend;      /* end of the last mark taken */
+  unsigned long long bytes[LATBUCKETS]; /* bytes sent per latency bucket */
+  unsigned long long total;
+  double             sum;          /* seconds, weighted by the bytes */
+  unsigned long      max;          /* microseconds */
+};
+static struct latency latency;     /* of all transfers */
+
+/* counters of all transfers, see metrics_start() */
+struct metrics
+{
+  unsigned long long bytes_in;
+  unsigned long long bytes_out;
+  unsigned long long writes;       /* sends, RTP packets and splices */
+  unsigned long long short_writes; /* the caster took less than offered */
+  unsigned long long eagain;       /* the caster took nothing */
+  unsigned long long frames_good;
+  unsigned long long frames_bad;
+  unsigned long long frames_filtered;
+  unsigned long      reconnects;
+  unsigned long long backlog_dropped; /* too old or no room, see -K */
+  unsigned long      failovers;    /* to the hot standby caster */
+  long long          lastoutput;   /* msec() of the last send */
+  int                gapopen;      /* no send since the transfer ended */
+  long long          gap;          /* ms without output, the last one */
+  long long          maxgap;
+  long long          ttfb;         /* ms from connect to the first reply */
+  unsigned long      fastopen_syn; /* requests the caster took with the SYN */
+  unsigned long      fastopen_handshake; /* sent after the handshake */
+  unsigned int       rtt;          /* of the caster connection, microseconds */
+  unsigned int       rttvar;
+  unsigned long long retransmits;  /* segments, of all connections */
+  unsigned int       connretrans;  /* of the current connection so far */
+  unsigned long      unacked;      /* bytes sent but not acknowledged */
+  unsigned long      unsent;       /* bytes in the kernel, not sent yet */
+  unsigned long long expired;      /* older than -w, dropped unsent */
+  int                outmode;      /* of the last transfer, after fallback */
+  int                connected;
+  long long          lastinput;    /* msec() */
+  size_t             queued;       /* output queue, updated by the sender */
+  size_t             queuesize;
+};
+static struct metrics metrics;
+
+/* ring buffer, see ring_init() */
+struct ringbuf
+{
+  char * data;
+  size_t size;
+  size_t head;
+  size_t tail;
+  size_t pending;    /* read behind head, not yet published */
+  int    framed;     /* sent in whole RTCM 3 frames, see rtcm_fit() */
+  int    expire;     /* holds whole frames for backlog_expire() */
+  int    finish;     /* send only up to frame for now */
+  size_t frame;      /* the next frame start at or behind the tail */
+  struct latency *lat;
+};
+
+/* RTCM 3 input framing, see rtcm_input() */
+struct rtcmframer
+{
+  enum RTCMMODE mode;
+  unsigned long good;     /* frames with a valid CRC */
+  unsigned long bad;      /* frames with a CRC error */
+  unsigned long skipped;  /* bytes dropped while searching a frame */
+  unsigned long filtered; /* valid frames dropped by the filter */
+  unsigned long filteredbytes;
+  struct rtcmfilter *filter; /* applied to the input, if any */
+};
+
+/* RTCM 3 message filter, see rtcm_filter() */
+#define MAXTHROTTLE 64
+
+struct rtcmthrottle
+{
+  int       type;
+  long long interval;   /* milliseconds */
+  long long last[64];   /* last forwarded, per satellite for ephemerides */
+};
+
+struct rtcmfilter
+{
+  int           active;
+  int           allowlist;    /* only types in allow pass */
+  unsigned char allow[4096/8];
+  unsigned char deny[4096/8];
+  long long     decimate;     /* observation epoch interval in ms, 0 = all */
+  int           throttles;
+  struct rtcmthrottle throttle[MAXTHROTTLE];
+};
+static struct rtcmfilter rtcmfilter; /* -A, -X, -L and -Z */
+
+/* HTTP chunk being sent, see send_queue() */
+#define MAXCHUNK 0x4000
+
+struct chunkstate
+{
+  char   head[12];
+  int    headlen;
+  int    headsent;
+  size_t left;       /* payload bytes of the current chunk not yet sent */
+  int    trailsent;
+  int    active;
+};
+
+#ifndef WINDOWSVERSION
+/* input queue filled by the input thread, see queue_start() */
+struct inputqueue
+{
+  struct ringbuf ring;
+  pthread_t      thread;
+  int            wakeup[2];  /* pipe, input thread -> output thread */
+  volatile int   sleeping;   /* output thread waits for the pipe */
+  int            space[2];   /* pipe, output thread -> input thread */
+  volatile int   full;       /* input thread waits for free space */
+  volatile int   done;       /* input thread has ended */
+  size_t         maxused;
+  unsigned long  dropped;
+  struct rtcmframer framer;
+};
+#endif /* WINDOWSVERSION */
+
+/* input kept open across caster reconnects, see backlog_wait() */
+struct backlog
+{
+  struct ringbuf     ring;    /* read by the sending thread */
+  struct rtcmframer  framer;
+#ifndef WINDOWSVERSION
+  struct inputqueue *queue;   /* -T thread, read by the input thread */
+#endif
+  int                open;    /* the input can serve the next transfer */
+};
+static struct backlog backlog;
+
+/* timed replay of the file input, see replay_read() */
+#define REPLAYSZ        131072  /* read ahead, holds any record */
+#define CAPMAGIC        "NTRIPCAP"
+
+struct replay
+{
+  int            active;    /* -t */
+  double         speed;     /* 0 = as fast as the caster takes it */
+  int            loop;
+  int            capture;   /* records with arrival times, else RTCM 3 */
+  int            start;     /* at the beginning of the file */
+  int            eof;       /* 1 at the end, -1 after a read error */
+  struct ringbuf ring;      /* read ahead */
+  size_t         ready;     /* due bytes at the tail */
+  long long      last;      /* time of the last record or epoch, -1 = none */
+  long long      interval;  /* between the last two, waited after a loop */
+  double         due;       /* msec() when the last one is due */
+};
+static struct replay replay;      /* -t */
+
+/* addresses of a host, see resolve_get() */
+#define MAXADDRS        8
+#define DNSCACHETIME    60  /* seconds the addresses are used as fresh */
+#define CONNECTTIME     10  /* seconds for a connect to the input or caster */
+#define CONNECTDELAY    250 /* ms until the next address joins the race */
+
+struct hostaddrs
+{
+  struct sockaddr_storage addr[MAXADDRS];
+  socklen_t               len[MAXADDRS];
+  int                     count;
+};
+
+struct resolve
+{
+  const char *     host;
+  unsigned int     port;
+  struct hostaddrs addrs;     /* of the last successful lookup */
+  time_t           expires;
+  int              error;     /* of the last lookup, see gai_strerror() */
+  int              running;   /* a lookup is under way */
+#ifndef WINDOWSVERSION
+  pthread_mutex_t  lock;
+#endif
+};
+static struct resolve inresolve;  /* -H */
+static struct resolve outresolve; /* -a or the proxy */
+
+#ifndef WINDOWSVERSION
+/* hot standby caster connection, see standby_thread() */
+struct standbytarget
+{
+  const char   *host;       /* caster, or the proxy of the primary one */
+  unsigned int  port;
+  const char   *caster;     /* for the Host header */
+  const char   *mountpoint;
+  const char   *extension;  /* "http://caster:port" through a proxy */
+  struct resolve *resolve;  /* the addresses of host */
+};
+
+struct standby
+{
+  struct standbytarget target[2]; /* the primary (-a) and the standby (-G) */
+  char            spec[2*SZ];     /* -G, split into host and mountpoint */
+  struct resolve  resolve;        /* of the standby caster */
+  const char     *authorization;
+  const char     *password;
+  const char     *ntrip_str;
+  int             outmode;
+  int             active;     /* target of the running transfer */
+  pthread_t       thread;
+  pthread_mutex_t lock;       /* ready, sock and active */
+  int             running;
+  volatile int    ready;      /* sock is accepted by the other target */
+  sockettype      sock;
+  sockettype      pending;    /* being connected */
+};
+static struct standby standby;
+#endif /* WINDOWSVERSION */
 
 /* Forward references */
 static void send_receive_loop(sockettype sock, int outmode,
   struct sockaddr * pcasterRTP, socklen_t length, unsigned int rtpssrc);
+static void send_transfer(sockettype sock, int outmode,
+  struct sockaddr * pcasterRTP, socklen_t length, unsigned int rtpssrc);
+static void transfer_data(sockettype sock, int outmode,
+  struct sockaddr * pcasterRTP, socklen_t length, unsigned int rtpssrc,
+  struct ringbuf *ring, struct inputqueue *queue);
+static long long msec(void);
+static long long usec(void);
+static int  wait_events(int waitinput, struct inputqueue *queue,
+  sockettype outsock, sockettype ctlsock, int timeout);
+static int  ring_init(struct ringbuf *r, size_t size);
+static void ring_free(struct ringbuf *r);
+static size_t ring_used(const struct ringbuf *r);
+static size_t ring_ready(const struct ringbuf *r);
+static size_t ring_room(const struct ringbuf *r);
+static int  ring_data(const struct ringbuf *r, size_t skip, struct iovec *iov,
+  size_t max);
+static int  ring_space(const struct ringbuf *r, struct iovec *iov);
+static void ring_produce(struct ringbuf *r, size_t n);
+static void ring_consume(struct ringbuf *r, size_t n);
+static int  ring_copy(struct ringbuf *r, const char *buf, int size);
+static void lat_attach(struct ringbuf *r, struct latency *l);
+static void lat_in(struct ringbuf *r);
+static void lat_out(struct ringbuf *r);
+static void lat_status(const struct latency *l, const char *name);
+#ifndef WINDOWSVERSION
+static int  metrics_start(const char *addr);
+#endif
+static void rtcm_init(struct rtcmframer *f, enum RTCMMODE mode);
+static void rtcm_input(struct ringbuf *r, struct rtcmframer *f, size_t n);
+static void rtcm_status(const struct rtcmframer *f);
+static size_t rtcm_fit(const struct ringbuf *r, size_t skip, size_t max);
+static int  rtcm_parsefilter(struct rtcmfilter *f, int option,
+            const char *list);
+static void metrics_sent(long long now);
+static struct ringbuf *backlog_queue(void);
+static void backlog_trim(struct ringbuf *r);
+static size_t backlog_expire(struct ringbuf *r, long long old);
+static int  replay_parse(const char *spec);
+static int  replay_open(struct replay *p);
+static void replay_resume(struct replay *p);
+static int  replay_read(struct replay *p, struct iovec *iov, int cnt,
+  long long now);
+static int  queue_pending(const struct ringbuf *q, const struct chunkstate *c);
+static int  queue_iov(int outmode, const struct ringbuf *q,
+  struct chunkstate *c, struct iovec *iov);
+static size_t queue_sent(int outmode, struct ringbuf *q, struct chunkstate *c,
+  size_t n);
+static int  send_queue(sockettype sock, int outmode, struct ringbuf *q,
+  struct chunkstate *c);
+static void rtp_header(unsigned char *h, int seq, unsigned int tim,
+  unsigned int ssrc);
+static int  send_rtp(sockettype sock, struct sockaddr *to, socklen_t tolen,
+  struct ringbuf *q, int *seq, unsigned int tim, unsigned int ssrc);
 static void usage(int, char *);
 static int  encode(char *buf, int size, const char *user, const char *pwd);
 static int  send_to_caster(char *input, sockettype socket, int input_size);
+static void close_input(void);
 static void close_session(const char *caster_addr, const char *mountpoint,
   int session, char *rtsp_ext, int fallback);
 static int  reconnect(int rec_sec, int rec_sec_max);
+static int  parse_inputmode(const char *mode);
+static int  parse_outputmode(const char *mode);
+static const char *addr_str(const struct sockaddr_storage *a, socklen_t len);
+static unsigned int addr_port(const struct sockaddr_storage *a);
+static void addr_setport(struct sockaddr_storage *a, unsigned int port);
+static void resolve_init(struct resolve *r, const char *host,
+            unsigned int port);
+static void resolve_start(struct resolve *r);
+static int  resolve_get(struct resolve *r, struct hostaddrs *a, int wait);
+static sockettype resolve_connect(const struct hostaddrs *a, int type,
+            const char *what, int tfo, int *used);
+static void fastopen_set(sockettype s);
+static void caster_sockopts(sockettype s, int dead, int gather, int age);
+#ifndef WINDOWSVERSION
+static void tcp_sample(sockettype s, long long now, int print);
+#endif
+static int  caster_reply(sockettype s, char *buf, int size,
+            long long *connstart);
+static int  build_caster_request(char *buf, size_t size, int outmode,
+  const char *extension, const char *mountpoint, const char *host,
+  const char *authorization, const char *password, const char *ntrip_str);
 static void handle_sigint(int sig);
 static void setup_signal_handler(int sig, void (*handler)(int));
 #ifndef WINDOWSVERSION
 static int  openserial(const char * tty, int blocksz, int baud);
 static void handle_sigpipe(int sig);
 static void handle_alarm(int sig);
+static void handle_sigusr1(int sig);
+static int  input_fd(void);
+static struct inputqueue *queue_start(size_t size);
+static void queue_stop(struct inputqueue *q);
+static int  queue_sleep(struct inputqueue *q);
+static void queue_awake(struct inputqueue *q);
+static void queue_status(const struct inputqueue *q);
+static void queue_consumed(struct inputqueue *q);
+static void backlog_wait(int sec);
+static int  standby_parse(const char *spec, unsigned int port);
+static void standby_start(int outmode);
+static int  standby_takeover(void);
+static void standby_stop(void);
+#ifdef HAVE_SPLICE
+static int  transfer_splice(sockettype sock);
+#endif
+#ifdef IO_URING
+static int  transfer_uring(sockettype sock, int outmode, struct ringbuf *ring);
+#endif
 #else
 static HANDLE openserial(const char * tty, int baud);
 #endif
+#ifdef HAVE_EPOLL
+static int  daemon_main(const char *configfile);
+#endif
 
 
 /*
@@ -189,7 +577,9 @@ int main(int argc, char **argv)
 
   char               get_extension[SZ] = "";
 
-  struct hostent *   he;
+  struct hostaddrs   addrs;
+  int                addrno = 0;
+  long long          connstart = 0;
 
   const char *       sisnetpassword = "";
   const char *       sisnetuser = "";
@@ -218,8 +608,8 @@ int main(int argc, char **argv)
 
   int                outputmode = NTRIP1;
 
-  struct sockaddr_in casterRTP;
-  struct sockaddr_in local;
+  struct sockaddr_storage casterRTP;
+  struct sockaddr_storage local;
   int                client_port = 0;
   int                server_port = 0;
   unsigned int       session = 0;
@@ -227,13 +617,15 @@ int main(int argc, char **argv)
   int                i = 0;
 
   char               szSendBuffer[BUFSZ];
-  char               authorization[SZ];
+  char               authorization[SZ] = "";
   int                nBufferBytes = 0;
   char *             dlim = " \r\n=";
   char *             token;
   char *             tok_buf[BUFSZ];
 
   int                reconnect_sec_max = 0;
+  const char *       configfile = NULL;
+  const char *       standbyspec = NULL;
 
   setbuf(stdout, 0);
   setbuf(stdin, 0);
@@ -264,6 +656,8 @@ int main(int argc, char **argv)
   setup_signal_handler(SIGPIPE, handle_sigpipe);
   /* setup signal handler for timeout */
   setup_signal_handler(SIGALRM, handle_alarm);
+  /* setup signal handler for status output */
+  setup_signal_handler(SIGUSR1, handle_sigusr1);
   alarm(ALARMTIME);
 #else
   /* winsock initialization */
@@ -282,19 +676,13 @@ int main(int argc, char **argv)
     exit(1);
   }
   while((c = getopt(argc, argv,
-  "M:i:h:b:p:s:a:m:c:H:P:f:x:y:l:u:V:D:U:W:O:E:F:R:N:n:B")) != EOF)
+  "M:i:h:b:p:s:a:m:c:H:P:f:x:y:l:u:V:D:U:W:O:E:F:R:N:n:BC:T:Q:K:r:A:X:L:Z:S:G:ok:gw:t:")) != EOF)
   {
     switch (c)
     {
     case 'M': /*** InputMode ***/
-      if(!strcmp(optarg, "serial"))         inputmode = SERIAL;
-      else if(!strcmp(optarg, "tcpsocket")) inputmode = TCPSOCKET;
-      else if(!strcmp(optarg, "file"))      inputmode = INFILE;
-      else if(!strcmp(optarg, "sisnet"))    inputmode = SISNET;
-      else if(!strcmp(optarg, "udpsocket")) inputmode = UDPSOCKET;
-      else if(!strcmp(optarg, "caster"))    inputmode = CASTER;
-      else inputmode = atoi(optarg);
-      if((inputmode == 0) || (inputmode >= LAST))
+      inputmode = parse_inputmode(optarg);
+      if(!inputmode)
       {
         fprintf(stderr, "ERROR: can't convert <%s> to a valid InputMode\n",
         optarg);
@@ -393,17 +781,8 @@ int main(int argc, char **argv)
        reconnect_sec_max = atoi(optarg);
        break;
     case 'O': /* OutputMode */
-      outputmode = 0;
-      if (!strcmp(optarg,"n") || !strcmp(optarg,"ntrip1"))
-        outputmode = NTRIP1;
-      else if(!strcmp(optarg,"h") || !strcmp(optarg,"http"))
-        outputmode = HTTP;
-      else if(!strcmp(optarg,"r") || !strcmp(optarg,"rtsp"))
-        outputmode = RTSP;
-      else if(!strcmp(optarg,"u") || !strcmp(optarg,"udp"))
-        outputmode = UDP;
-      else outputmode = atoi(optarg);
-      if((outputmode == 0) || (outputmode >= END))
+      outputmode = parse_outputmode(optarg);
+      if(!outputmode)
       {
         fprintf(stderr, "ERROR: can't convert <%s> to a valid OutputMode\n",
         optarg);
@@ -416,6 +795,99 @@ int main(int argc, char **argv)
     case 'N': /* Ntrip-STR, optional for Ntrip Version 2.0 */
       ntrip_str = optarg;
       break;
+    case 'C': /* config file for daemon mode */
+      configfile = optarg;
+      break;
+    case 'T': /* transfer method */
+      if(!strcmp(optarg, "loop"))        transfer = LOOP;
+#ifndef WINDOWSVERSION
+      else if(!strcmp(optarg, "thread")) transfer = THREAD;
+#endif
+#ifdef HAVE_SPLICE
+      else if(!strcmp(optarg, "splice")) transfer = SPLICE;
+#endif
+#ifdef IO_URING
+      else if(!strcmp(optarg, "uring"))  transfer = URING;
+#endif
+      else
+      {
+        fprintf(stderr, "ERROR: unknown transfer method <%s>\n", optarg);
+        usage(-1, argv[0]);
+      }
+      break;
+    case 'Q': /* size of the input queue */
+      queuesize = atoi(optarg);
+      if(queuesize < BUFSZ)
+      {
+        fprintf(stderr, "ERROR: queue size <%s> below %d bytes\n", optarg,
+        BUFSZ);
+        usage(-1, argv[0]);
+      }
+      break;
+    case 'K': /* maximum age of the input kept while reconnecting */
+      backlogage = atoi(optarg);
+      if(backlogage < 0)
+      {
+        fprintf(stderr, "ERROR: invalid age <%s>\n", optarg);
+        usage(-1, argv[0]);
+      }
+      break;
+    case 'r': /* RTCM 3 framing of the input */
+      if(!strcmp(optarg, "none"))       rtcmmode = RTCM_NONE;
+      else if(!strcmp(optarg, "check")) rtcmmode = RTCM_CHECK;
+      else if(!strcmp(optarg, "align")) rtcmmode = RTCM_ALIGN;
+      else
+      {
+        fprintf(stderr, "ERROR: unknown RTCM mode <%s>\n", optarg);
+        usage(-1, argv[0]);
+      }
+      break;
+#ifndef WINDOWSVERSION
+    case 'S': /* metrics endpoint */
+      metricsaddr = optarg;
+      break;
+    case 'G': /* hot standby caster */
+      standbyspec = optarg;
+      break;
+#endif
+    case 'o': /* TCP Fast Open */
+      fastopen = 1;
+      break;
+    case 'k': /* dead caster connection timeout */
+      if((deadtime = atoi(optarg)) < 0)
+      {
+        fprintf(stderr, "ERROR: invalid timeout <%s>\n", optarg);
+        usage(-1, argv[0]);
+      }
+      break;
+    case 'g': /* Nagle's algorithm */
+      nagle = 1;
+      break;
+    case 't': /* timed replay of the file input */
+      if(!replay_parse(optarg))
+      {
+        fprintf(stderr, "ERROR: invalid replay speed <%s>\n", optarg);
+        usage(-1, argv[0]);
+      }
+      break;
+    case 'w': /* maximum age of the data sent to the caster */
+      if((maxage = atoi(optarg)) < 0)
+      {
+        fprintf(stderr, "ERROR: invalid age <%s>\n", optarg);
+        usage(-1, argv[0]);
+      }
+      break;
+    case 'A': /* RTCM 3 message filter */
+    case 'X':
+    case 'L':
+    case 'Z':
+      if(!rtcm_parsefilter(&rtcmfilter, c, optarg))
+      {
+        fprintf(stderr, "ERROR: invalid message filter -%c <%s>\n", c,
+        optarg);
+        usage(-1, argv[0]);
+      }
+      break;
     case 'h': /* print help screen */
     case '?':
       usage(0, argv[0]);
@@ -429,6 +901,18 @@ int main(int argc, char **argv)
   argc -= optind;
   argv += optind;
 
+  /* the filter and -w work on whole frames */
+  if((rtcmfilter.active || maxage) && rtcmmode == RTCM_NONE)
+    rtcmmode = RTCM_CHECK;
+  /* room for an incomplete frame besides a full read */
+  if(rtcmmode != RTCM_NONE && queuesize < 4*BUFSZ)
+    queuesize = 4*BUFSZ;
+  if(replay.active && inputmode != INFILE)
+  {
+    fprintf(stderr, "ERROR: replay (-t) needs file input (-M 3)\n");
+    usage(-1, argv[0]);
+  }
+
   /*** argument analysis ***/
   if(argc > 0)
   {
@@ -441,6 +925,21 @@ int main(int argc, char **argv)
     usage(1, argv[0]);                   /* never returns */
   }
 
+  if(configfile)
+  {
+#ifdef HAVE_EPOLL
+    return daemon_main(configfile);
+#else
+    fprintf(stderr, "ERROR: daemon mode is not supported on this system\n");
+    exit(1);
+#endif
+  }
+
+#ifndef WINDOWSVERSION
+  if(metricsaddr && !metrics_start(metricsaddr))
+    exit(1);
+#endif
+
   if((reconnect_sec_max > 0) && (reconnect_sec_max < 256))
   {
     fprintf(stderr,
@@ -518,27 +1017,59 @@ int main(int argc, char **argv)
     outhost   = casterouthost; outport = casteroutport;
     inhost    = casterinhost;  inport  = casterinport;
   }
+  /* the caster is looked up while the input is opened */
+  resolve_init(&outresolve, outhost, outport);
+
+#ifndef WINDOWSVERSION
+  /*** hot standby caster ***/
+  if(standbyspec)
+  {
+    if(!standby_parse(standbyspec, casteroutport))
+    {
+      fprintf(stderr, "ERROR: invalid standby caster <%s>\n", standbyspec);
+      usage(-1, argv[0]);
+    }
+    standby.target[0].host = outhost;
+    standby.target[0].port = outport;
+    standby.target[0].resolve = &outresolve;
+    standby.target[0].caster = casterouthost;
+    standby.target[0].mountpoint = mountpoint;
+    standby.target[0].extension = post_extension;
+    standby.authorization = authorization;
+    standby.password = password;
+    standby.ntrip_str = ntrip_str;
+  }
+#endif
 
   while(inputmode != LAST)
   {
     int input_init = 1;
     if(sigint_received) break;
     /*** InputMode handling ***/
-    switch(inputmode)
+    /* an input kept open across the reconnect needs no new handshake */
+    if(backlog.open)
+      fprintf(stderr, "input kept open, %lu bytes queued\n",
+      (unsigned long)metrics.queued);
+    else switch(inputmode)
     {
     case INFILE:
       {
+        struct stat st;
+
         if((gps_file = open(filepath, O_RDONLY)) < 0)
         {
           perror("ERROR: opening input file");
           exit(1);
         }
+        regularfile = !fstat(gps_file, &st) && S_ISREG(st.st_mode);
 #ifndef WINDOWSVERSION
         /* set blocking inputmode in case it was not set
           (seems to be sometimes for fifo's) */
         fcntl(gps_file, F_SETFL, 0);
 #endif
         printf("file input: file = %s\n", filepath);
+        if(replay.active && !replay_open(&replay))
+          exit(1);
       }
       break;
     case SERIAL: /* open serial port */
@@ -616,13 +1147,17 @@ int main(int argc, char **argv)
           if(!inhost) inhost = SERV_HOST_ADDR;
         }
 
-        if(!(he = gethostbyname(inhost)))
+        if(!bindmode)
         {
-          fprintf(stderr, "ERROR: Input host <%s> unknown\n", inhost);
-          usage(-2, argv[0]);
+          if(!inresolve.host)
+            resolve_init(&inresolve, inhost, inport);
+          if(resolve_get(&inresolve, &addrs, 1) <= 0)
+          {
+            fprintf(stderr, "ERROR: Input host <%s> unknown\n", inhost);
+            usage(-2, argv[0]);
+          }
         }
-
-        if((gps_socket = socket(AF_INET, inputmode == UDPSOCKET
+        else if((gps_socket = socket(AF_INET, inputmode == UDPSOCKET
         ? SOCK_DGRAM : SOCK_STREAM, 0)) == INVALID_SOCKET)
         {
           fprintf(stderr,
@@ -630,22 +1165,11 @@ int main(int argc, char **argv)
           exit(1);
         }
 
-        memset((char *) &caster, 0x00, sizeof(caster));
-        if(!bindmode)
-          memcpy(&caster.sin_addr, he->h_addr, (size_t)he->h_length);
-        caster.sin_family = AF_INET;
-        caster.sin_port = htons(inport);
-
-        fprintf(stderr, "%s input: host = %s, port = %d, %s%s%s%s%s\n",
-        inputmode == CASTER ? "caster" : inputmode == SISNET ? "sisnet" :
-        inputmode == TCPSOCKET ? "tcp socket" : "udp socket",
-        bindmode ? "127.0.0.1" : inet_ntoa(caster.sin_addr),
-        inport, stream_name ? "stream = " : "", stream_name ? stream_name : "",
-        initfile ? ", initfile = " : "", initfile ? initfile : "",
-        bindmode ? "binding mode" : "");
-
         if(bindmode)
         {
+          memset((char *) &caster, 0x00, sizeof(caster));
+          caster.sin_family = AF_INET;
+          caster.sin_port = htons(inport);
           if(bind(gps_socket, (struct sockaddr *) &caster, sizeof(caster)) < 0)
           {
             fprintf(stderr, "ERROR: can't bind input to port %d\n", inport);
@@ -654,21 +1178,29 @@ int main(int argc, char **argv)
             break;
           }
         } /* connect to input-caster or proxy server*/
-        else if(connect(gps_socket, (struct sockaddr *)&caster, sizeof(caster)) < 0)
+        else if((gps_socket = resolve_connect(&addrs, inputmode == UDPSOCKET
+        ? SOCK_DGRAM : SOCK_STREAM, "input", 0, &addrno)) == INVALID_SOCKET)
         {
-          fprintf(stderr, "WARNING: can't connect input to %s at port %d\n",
-          inet_ntoa(caster.sin_addr), inport);
           input_init = 0;
           break;
         }
 
+        fprintf(stderr, "%s input: host = %s, port = %d, %s%s%s%s%s\n",
+        inputmode == CASTER ? "caster" : inputmode == SISNET ? "sisnet" :
+        inputmode == TCPSOCKET ? "tcp socket" : "udp socket",
+        bindmode ? "127.0.0.1" : addr_str(&addrs.addr[addrno],
+        addrs.len[addrno]),
+        inport, stream_name ? "stream = " : "", stream_name ? stream_name : "",
+        initfile ? ", initfile = " : "", initfile ? initfile : "",
+        bindmode ? "binding mode" : "");
+
         if(stream_name) /* input from Ntrip Version 1.0 caster*/
         {
           int init = 0;
 
           /* set socket buffer size */
           setsockopt(gps_socket, SOL_SOCKET, SO_SNDBUF, (const char *) &size,
-            sizeof(const char *));
+            sizeof(size));
           if(stream_user && stream_password)
           {
             /* leave some space for login */
@@ -873,6 +1405,8 @@ int main(int argc, char **argv)
       break;
     }
 
+    backlog.open = input_init;
+
     /* ----- main part ----- */
     int output_init = 1, fallback = 0;
 
@@ -883,7 +1417,8 @@ int main(int argc, char **argv)
 #else
       if((sigalarm_received) || (sigint_received)) break;
 #endif
-      if(!(he = gethostbyname(outhost)))
+      /* the addresses were looked up meanwhile, see resolve_start() */
+      if(resolve_get(&outresolve, &addrs, 1) <= 0)
       {
         fprintf(stderr, "ERROR: Destination caster or proxy host <%s> unknown\n",
         outhost);
@@ -891,32 +1426,19 @@ int main(int argc, char **argv)
         usage(-2, argv[0]);
       }
 
-      /* create socket */
-      if((socket_tcp = socket(AF_INET, (outputmode == UDP ? SOCK_DGRAM
-      : SOCK_STREAM), 0)) == INVALID_SOCKET)
-      {
-        perror("ERROR: tcp socket");
-        reconnect_sec_max = 0;
+      /* connect to Destination caster or Proxy server*/
+      connstart = msec();
+      if((socket_tcp = resolve_connect(&addrs, outputmode == UDP
+      ? SOCK_DGRAM : SOCK_STREAM, "output", fastopen, &addrno))
+      == INVALID_SOCKET)
         break;
-      }
+      if(outputmode != UDP)
+        caster_sockopts(socket_tcp, deadtime, nagle, maxage);
 
-      memset((char *) &caster, 0x00, sizeof(caster));
-      memcpy(&caster.sin_addr, he->h_addr, (size_t)he->h_length);
-      caster.sin_family = AF_INET;
-      caster.sin_port = htons(outport);
-
-      /* connect to Destination caster or Proxy server*/
       fprintf(stderr, "caster output: host = %s, port = %d, mountpoint = %s"
-      ", mode = %s\n\n", inet_ntoa(caster.sin_addr), outport, mountpoint,
-      outputmode == NTRIP1 ? "ntrip1" : outputmode == HTTP ? "http" :
-      outputmode == UDP ? "udp" : "rtsp");
-
-      if(connect(socket_tcp, (struct sockaddr *) &caster, sizeof(caster)) < 0)
-      {
-        fprintf(stderr, "WARNING: can't connect output to %s at port %d\n",
-          inet_ntoa(caster.sin_addr), outport);
-        break;
-      }
+      ", mode = %s\n\n", addr_str(&addrs.addr[addrno], addrs.len[addrno]),
+      outport, mountpoint, outputmode == NTRIP1 ? "ntrip1" : outputmode == HTTP
+      ? "http" : outputmode == UDP ? "udp" : "rtsp");
 
       /*** OutputMode handling ***/
       switch(outputmode)
@@ -987,7 +1509,8 @@ int main(int argc, char **argv)
               {
                 int stop = 0;
                 int numbytes;
-                if((numbytes=recv(socket_tcp, rtpbuf, sizeof(rtpbuf)-1, 0)) > 0)
+                if((numbytes=caster_reply(socket_tcp, rtpbuf, sizeof(rtpbuf)-1,
+                &connstart)) > 0)
                 {
                   /* we don't expect message longer than 1513, so we cut the last
                     byte for security reasons to prevent buffer overrun */
@@ -1064,10 +1587,9 @@ int main(int argc, char **argv)
           break;
         case NTRIP1: /*** OutputMode Ntrip Version 1.0 ***/
           fallback = 0;
-          nBufferBytes = snprintf(szSendBuffer, sizeof(szSendBuffer),
-            "SOURCE %s %s/%s\r\n"
-            "Source-Agent: %s/%s\r\n\r\n",
-            password, post_extension, mountpoint, AGENTSTRING, revisionstr);
+          nBufferBytes = build_caster_request(szSendBuffer,
+            sizeof(szSendBuffer), NTRIP1, post_extension, mountpoint,
+            casterouthost, authorization, password, ntrip_str);
           if((nBufferBytes > (int)sizeof(szSendBuffer)) || (nBufferBytes < 0))
           {
             fprintf(stderr, "ERROR: Destination caster request to long\n");
@@ -1081,7 +1603,8 @@ int main(int argc, char **argv)
             break;
           }
           /* check Destination caster's response */
-          nBufferBytes = recv(socket_tcp, szSendBuffer, sizeof(szSendBuffer), 0);
+          nBufferBytes = caster_reply(socket_tcp, szSendBuffer,
+          sizeof(szSendBuffer), &connstart);
           szSendBuffer[nBufferBytes] = '\0';
           if(!strstr(szSendBuffer, "OK"))
           {
@@ -1110,17 +1633,9 @@ int main(int argc, char **argv)
           input_init = output_init = 0;
           break;
         case HTTP: /*** Ntrip-Version 2.0 HTTP/1.1 ***/
-          nBufferBytes = snprintf(szSendBuffer, sizeof(szSendBuffer),
-            "POST %s/%s HTTP/1.1\r\n"
-            "Host: %s\r\n"
-            "Ntrip-Version: Ntrip/2.0\r\n"
-            "User-Agent: %s/%s\r\n"
-            "Authorization: Basic %s%s%s\r\n"
-            "Connection: close\r\n"
-            "Transfer-Encoding: chunked\r\n\r\n",
-            post_extension, mountpoint, casterouthost, AGENTSTRING,
-            revisionstr, authorization, ntrip_str ? "\r\nNtrip-STR: " : "",
-            ntrip_str);
+          nBufferBytes = build_caster_request(szSendBuffer,
+            sizeof(szSendBuffer), HTTP, post_extension, mountpoint,
+            casterouthost, authorization, password, ntrip_str);
           if((nBufferBytes > (int)sizeof(szSendBuffer)) || (nBufferBytes < 0))
           {
             fprintf(stderr, "ERROR: Destination caster request to long\n");
@@ -1134,7 +1649,8 @@ int main(int argc, char **argv)
             break;
           }
           /* check Destination caster's response */
-          nBufferBytes = recv(socket_tcp, szSendBuffer, sizeof(szSendBuffer), 0);
+          nBufferBytes = caster_reply(socket_tcp, szSendBuffer,
+          sizeof(szSendBuffer), &connstart);
           szSendBuffer[nBufferBytes] = '\0';
           if(!strstr(szSendBuffer, "HTTP/1.1 200 OK"))
           {
@@ -1179,17 +1695,20 @@ int main(int argc, char **argv)
           input_init = output_init = 0;
           break;
         case RTSP: /*** Ntrip-Version 2.0 RTSP / RTP ***/
-          if((socket_udp = socket(AF_INET, SOCK_DGRAM,0)) == INVALID_SOCKET)
+          /* CSeq counts per control connection, the replies are checked
+             for CSeq 1 and 2 below */
+          udp_cseq = 1;
+          if((socket_udp = socket(addrs.addr[addrno].ss_family, SOCK_DGRAM,
+          0)) == INVALID_SOCKET)
           {
             perror("ERROR: udp socket");
             exit(4);
           }
-          /* fill structure with local address information for UDP */
+          /* fill structure with local address information for UDP, any
+             address of the family of the caster */
           memset(&local, 0, sizeof(local));
-          local.sin_family = AF_INET;
-          local.sin_port = htons(0);
-          local.sin_addr.s_addr = htonl(INADDR_ANY);
-          len = (socklen_t)sizeof(local);
+          local.ss_family = addrs.addr[addrno].ss_family;
+          len = addrs.len[addrno];
           /* bind() in order to get a random RTP client_port */
           if((bind(socket_udp,(struct sockaddr *)&local, len)) < 0)
           {
@@ -1200,7 +1719,7 @@ int main(int argc, char **argv)
           }
           if((getsockname(socket_udp, (struct sockaddr*)&local, &len)) != -1)
           {
-            client_port = (unsigned int)ntohs(local.sin_port);
+            client_port = addr_port(&local);
           }
           else
           {
@@ -1232,8 +1751,8 @@ int main(int argc, char **argv)
             output_init = 0;
             break;
           }
-          while((nBufferBytes = recv(socket_tcp, szSendBuffer,
-          sizeof(szSendBuffer), 0)) > 0)
+          while((nBufferBytes = caster_reply(socket_tcp, szSendBuffer,
+          sizeof(szSendBuffer), &connstart)) > 0)
           {
             /* check Destination caster's response */
             szSendBuffer[nBufferBytes] = '\0';
@@ -1328,23 +1847,10 @@ int main(int argc, char **argv)
             else if((strstr(szSendBuffer,"RTSP/1.0 200 OK\r\n")) && (strstr(szSendBuffer,
             "CSeq: 2\r\n")))
             {
-              /* fill structure with caster address information for UDP */
-              memset(&casterRTP, 0, sizeof(casterRTP));
-              casterRTP.sin_family = AF_INET;
-              casterRTP.sin_port   = htons(((uint16_t)server_port));
-              if((he = gethostbyname(outhost))== NULL)
-              {
-                fprintf(stderr, "ERROR: Destination caster unknown\n");
-                reconnect_sec_max = 0;
-                output_init = 0;
-                break;
-              }
-              else
-              {
-                memcpy((char *)&casterRTP.sin_addr.s_addr,
-                he->h_addr_list[0], (size_t)he->h_length);
-              }
-              len = (socklen_t)sizeof(casterRTP);
+              /* RTP goes to the address the control connection uses */
+              casterRTP = addrs.addr[addrno];
+              addr_setport(&casterRTP, server_port);
+              len = addrs.len[addrno];
               send_receive_loop(socket_udp, outputmode, (struct sockaddr *)&casterRTP,
               (socklen_t)len, session);
               break;
@@ -1355,7 +1861,15 @@ int main(int argc, char **argv)
           break;
       }
     }
-    close_session(casterouthost, mountpoint, session, rtsp_extension, 0);
+    /* the input stays open for the next transfer, unless it failed */
+    if(!(reconnect_sec_max || fallback) || sigint_received)
+      backlog.open = 0;
+    /* refresh the addresses during the reconnect delay */
+    resolve_start(&outresolve);
+    if(!backlog.open)
+      resolve_start(&inresolve);
+    close_session(casterouthost, mountpoint, session, rtsp_extension,
+    backlog.open);
     if( (reconnect_sec_max || fallback) && !sigint_received )
       reconnect_sec = reconnect(reconnect_sec, reconnect_sec_max);
     else inputmode = LAST;
@@ -1366,360 +1880,591 @@ int main(int argc, char **argv)
 static void send_receive_loop(sockettype sock, int outmode, struct sockaddr* pcasterRTP,
 socklen_t length, unsigned int rtpssrc)
 {
-  int      nodata = 0;
-  char     buffer[BUFSZ] = { 0 };
-  char     sisnetbackbuffer[200];
-  char     szSendBuffer[BUFSZ] = "";
-  int      nBufferBytes = 0;
+  metrics.outmode = outmode;
+  metrics.connected = 1;
+  metrics.connretrans = 0;
+#ifndef WINDOWSVERSION
+  if(outmode == NTRIP1 || outmode == HTTP)
+    standby_start(outmode);
+#endif
+  send_transfer(sock, outmode, pcasterRTP, length, rtpssrc);
+  metrics.gapopen = 1;
+#ifndef WINDOWSVERSION
+  /* the standby caster goes on with the queue as it is, unless the input
+     failed */
+  while(backlog.open && !sigint_received && standby_takeover())
+  {
+    metrics.connretrans = 0;
+    send_transfer(socket_tcp, outmode, NULL, 0, 0);
+    metrics.gapopen = 1;
+  }
+  standby_stop();
+#endif
+  metrics.connected = 0;
+  metrics.queued = 0;
+}
 
-   /* RTSP / RTP Mode */
-  int      isfirstpacket = 1;
-  struct   timeval now;
-  struct   timeval last = {0,0};
-  long int sendtimediff;
-  int      rtpseq = 0;
-  int      rtptime = 0;
-  time_t   laststate = time(0);
+/* runs the transfer method chosen with -T */
+static void send_transfer(sockettype sock, int outmode,
+struct sockaddr* pcasterRTP, socklen_t length, unsigned int rtpssrc)
+{
+  struct ringbuf *ring;
 
-  if(outmode == UDP)
+#ifdef HAVE_SPLICE
+  /* the data never passes user space, so only unchecked raw byte streams
+     work */
+  if(transfer == SPLICE)
   {
-    rtptime = time(0);
-#ifdef WINDOWSVERSION
-    u_long blockmode = 1;
-    if(ioctlsocket(socket_tcp, FIONBIO, &blockmode))
-#else /* WINDOWSVERSION */
-    if(fcntl(socket_tcp, F_SETFL, O_NONBLOCK) < 0)
-#endif /* WINDOWSVERSION */
+    if(outmode == NTRIP1 && rtcmmode == RTCM_NONE && (inputmode == TCPSOCKET
+    || inputmode == SERIAL || (inputmode == INFILE && !replay.active)
+    || inputmode == CASTER))
     {
-      fprintf(stderr, "Could not set nonblocking mode\n");
-      return;
+      if(!transfer_splice(sock))
+        return;
     }
+    fprintf(stderr, "NOTE: input can't be spliced, using -T loop\n");
+    transfer = LOOP;
   }
-  else if(outmode == RTSP)
+#endif
+  /* the queue outlives the transfer, what arrived while the caster was
+     away goes first */
+  if(!(ring = backlog_queue()))
+    return;
+  metrics.queuesize = ring->size;
+  backlog_trim(ring);
+  if(ring_used(ring))
+    fprintf(stderr, "sending %lu bytes kept from the input\n",
+    (unsigned long)ring_used(ring));
+  /* the input thread goes on with the replay while the caster is away */
+  if(replay.active && transfer != THREAD)
+    replay_resume(&replay);
+#ifndef WINDOWSVERSION
+  /* with a separate input thread a stalled caster can't block the input */
+  if(transfer == THREAD)
   {
-#ifdef WINDOWSVERSION
-    u_long blockmode = 1;
-    if(ioctlsocket(socket_tcp, FIONBIO, &blockmode))
-#else /* WINDOWSVERSION */
-    if(fcntl(socket_tcp, F_SETFL, O_NONBLOCK) < 0)
-#endif /* WINDOWSVERSION */
-    {
-      fprintf(stderr, "Could not set nonblocking mode\n");
-      return;
-    }
+    transfer_data(sock, outmode, pcasterRTP, length, rtpssrc, ring,
+    backlog.queue);
+    queue_status(backlog.queue);
+    return;
   }
-
-  /* data transmission */
-  fprintf(stderr,"transfering data ...\n");
-  int  send_recv_success = 0;
-#ifdef WINDOWSVERSION
-  time_t nodata_begin = 0, nodata_current = 0;
 #endif
-  while(1)
+#ifdef IO_URING
+  if(transfer == URING)
   {
-    if(send_recv_success < 3) send_recv_success++;
-    if(!nodata)
-    {
+    if((outmode == NTRIP1 || outmode == HTTP) && inputmode != SISNET
+    && !replay.active && !transfer_uring(sock, outmode, ring))
+      return;
+    fprintf(stderr, "NOTE: io_uring can't be used, using -T loop\n");
+    transfer = LOOP;
+  }
+#endif
+  transfer_data(sock, outmode, pcasterRTP, length, rtpssrc, ring, NULL);
+}
+
+/* milliseconds of a clock which is not set back */
+static long long msec(void)
+{
 #ifndef WINDOWSVERSION
-      alarm(ALARMTIME);
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000LL + ts.tv_nsec/1000000;
 #else
-      time(&nodata_begin);
+  return GetTickCount64();
 #endif
-    }
-    else
-    {
-      nodata = 0;
-#ifdef WINDOWSVERSION
-      time(&nodata_current);
-      if(difftime(nodata_current, nodata_begin) >= ALARMTIME)
-      {
-        sigalarm_received = 1;
-        fprintf(stderr, "ERROR: more than %d seconds no activity\n", ALARMTIME);
-      }
-#endif
-    }
-    /* signal handling*/
-#ifdef WINDOWSVERSION
-    if((sigalarm_received) || (sigint_received)) break;
+} /* msec */
+
+/* microseconds of the same clock, for latency measurements */
+static long long usec(void)
+{
+#ifndef WINDOWSVERSION
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000000LL + ts.tv_nsec/1000;
 #else
-    if((sigalarm_received) || (sigint_received) || (sigpipe_received)) break;
+  LARGE_INTEGER c, f;
+
+  QueryPerformanceCounter(&c);
+  QueryPerformanceFrequency(&f);
+  return c.QuadPart/f.QuadPart*1000000LL
+  + c.QuadPart%f.QuadPart*1000000LL/f.QuadPart;
 #endif
-    if(!nBufferBytes)
-    {
-      if(inputmode == SISNET && sisnet <= 30)
-      {
-        int i;
-        /* a somewhat higher rate than 1 second to get really each block */
-        /* means we need to skip double blocks sometimes */
-        struct timeval tv = {0,700000};
-        select(0, 0, 0, 0, &tv);
-        memcpy(sisnetbackbuffer, buffer, sizeof(sisnetbackbuffer));
-        i = (sisnet >= 30 ? 5 : 3);
-        if((send(gps_socket, "MSG\r\n", i, 0)) != i)
-        {
-          perror("WARNING: sending SISNeT data request failed");
-          return;
-        }
-      }
-      /*** receiving data ****/
-      if(inputmode == INFILE)
-        nBufferBytes = read(gps_file, buffer, sizeof(buffer));
-      else if(inputmode == SERIAL)
-      {
+} /* usec */
+
+/* Wait up to timeout milliseconds for input (or queued input from the
+   input thread), for the caster socket to take data and for replies on
+   the control socket. Returns the WAIT_* events which occurred. */
+static int wait_events(int waitinput, struct inputqueue *queue,
+sockettype outsock, sockettype ctlsock, int timeout)
+{
+  int ev = 0;
 #ifndef WINDOWSVERSION
-        nBufferBytes = read(gps_serial, buffer, sizeof(buffer));
+  struct pollfd pfd[3];
+  int           n = 0, in = -1, out = -1, ctl = -1;
+
+  if(waitinput)
+  {
+    in = n;
+    pfd[n].fd = queue ? queue->wakeup[0] : input_fd();
+    pfd[n++].events = POLLIN;
+  }
+  if(outsock != INVALID_SOCKET)
+  {
+    out = n;
+    pfd[n].fd = outsock;
+    pfd[n++].events = POLLOUT;
+  }
+  if(ctlsock != INVALID_SOCKET)
+  {
+    ctl = n;
+    pfd[n].fd = ctlsock;
+    pfd[n++].events = POLLIN;
+  }
+  if(poll(pfd, n, timeout) <= 0)
+    return 0;
+  if(in >= 0 && pfd[in].revents) ev |= WAIT_IN;
+  if(out >= 0 && pfd[out].revents) ev |= WAIT_OUT;
+  if(ctl >= 0 && pfd[ctl].revents) ev |= WAIT_CTL;
 #else
-        DWORD nRead = 0;
-        if(!ReadFile(gps_serial, buffer, sizeof(buffer), &nRead, NULL))
-        {
-          fprintf(stderr,"ERROR: reading serial input failed\n");
-          return;
-        }
-        nBufferBytes = (int)nRead;
+  fd_set         rfds, wfds;
+  struct timeval tv;
+  SOCKET         max = 0;
+
+  FD_ZERO(&rfds);
+  FD_ZERO(&wfds);
+  /* serial and file input can't be selected, they are always read */
+  if(waitinput && (inputmode == SERIAL || inputmode == INFILE))
+  {
+    ev |= WAIT_IN;
+    timeout = 0;
+  }
+  else if(waitinput)
+  {
+    FD_SET(gps_socket, &rfds);
+    max = gps_socket;
+  }
+  if(outsock != INVALID_SOCKET)
+  {
+    FD_SET(outsock, &wfds);
+    if(outsock > max) max = outsock;
+  }
+  if(ctlsock != INVALID_SOCKET)
+  {
+    FD_SET(ctlsock, &rfds);
+    if(ctlsock > max) max = ctlsock;
+  }
+  tv.tv_sec = timeout/1000;
+  tv.tv_usec = (timeout%1000)*1000;
+  if(select(max+1, &rfds, &wfds, 0, &tv) <= 0)
+    return ev;
+  if(waitinput && !ev && FD_ISSET(gps_socket, &rfds)) ev |= WAIT_IN;
+  if(outsock != INVALID_SOCKET && FD_ISSET(outsock, &wfds)) ev |= WAIT_OUT;
+  if(ctlsock != INVALID_SOCKET && FD_ISSET(ctlsock, &rfds)) ev |= WAIT_CTL;
 #endif
-      }
-      else
+  return ev;
+} /* wait_events */
+
+/********************************************************************
+ * transfer_data
+ *
+ * Forwards the input to the caster. The loop is driven by the events
+ * of wait_events(): input is read only when it is readable and data is
+ * sent while the caster takes it, the control connection of the RTSP
+ * and UDP modes is only read when a reply arrived. Inactivity, file
+ * polling, SISNeT requests and RTSP/UDP keepalives are deadlines which
+ * limit the wait, so nothing sleeps and no signal is needed.
+ *
+ ********************************************************************/
+static void transfer_data(sockettype sock, int outmode,
+struct sockaddr* pcasterRTP, socklen_t length, unsigned int rtpssrc,
+struct ringbuf *ring, struct inputqueue *queue)
+{
+  char      buffer[BUFSZ] = { 0 };
+  char      sisnetbackbuffer[200];
+  int       nBufferBytes = 0;
+  int       events = 0, blocked = 0, inputend = 0, waitinput, progress;
+  size_t    expired;
+  int       sisnetsent = 0, send_recv_success = 0;
+  long long now, next, lastinput, inputretry = 0, sisnetnext = 0;
+  struct    chunkstate chunk;
+  sockettype ctlsock = INVALID_SOCKET;
+
+   /* RTSP / RTP Mode */
+  int       isfirstpacket = 1;
+  struct    timeval tnow;
+  struct    timeval last = {0,0};
+  long int  sendtimediff;
+  int       rtpseq = 0;
+  int       rtptime = 0;
+  long long laststate, rtpalive;
+
+  memset(&chunk, 0, sizeof(chunk));
+  if(outmode == UDP || outmode == RTSP)
+  {
 #ifdef WINDOWSVERSION
-        nBufferBytes = recv(gps_socket, buffer, sizeof(buffer), 0);
-#else
-        nBufferBytes = read(gps_socket, buffer, sizeof(buffer));
+    u_long blockmode = 1;
+    if(ioctlsocket(socket_tcp, FIONBIO, &blockmode))
+#else /* WINDOWSVERSION */
+    if(fcntl(socket_tcp, F_SETFL, O_NONBLOCK) < 0)
+#endif /* WINDOWSVERSION */
+    {
+      fprintf(stderr, "Could not set nonblocking mode\n");
+      return;
+    }
+    ctlsock = socket_tcp;
+  }
+  /* data is always sent with MSG_DONTWAIT, serial input is non-blocking
+     already and reads only follow a readable input */
+#ifndef WINDOWSVERSION
+  alarm(0);
 #endif
-      if(!nBufferBytes)
+  now = lastinput = laststate = rtpalive = msec();
+
+  /* data transmission */
+  fprintf(stderr,"transfering data ...\n");
+  while(1)
+  {
+    if(send_recv_success < 3 && ++send_recv_success == 3) reconnect_sec = 1;
+    /* signal handling*/
+#ifdef WINDOWSVERSION
+    if(sigint_received) break;
+#else
+    if((sigint_received) || (sigpipe_received)) break;
+    if(sigusr1_received)
+    {
+      sigusr1_received = 0;
+      if(queue)
+        queue_status(queue);
+      else
       {
-        fprintf(stderr, "WARNING: no data received from input\n");
-        nodata = 1;
+        fprintf(stderr, "output queue: %lu of %lu bytes used\n",
+        (unsigned long)ring_used(ring), (unsigned long)ring->size);
+        rtcm_status(&backlog.framer);
+        lat_status(ring->lat, 0);
+      }
+      tcp_sample(socket_tcp, msec(), 1);
+    }
+#endif
+    now = msec();
 #ifndef WINDOWSVERSION
-        sleep(3);
-#else
-        Sleep(3*1000);
+    tcp_sample(socket_tcp, now, 0);
 #endif
-        continue;
-      }
-      else if((nBufferBytes < 0) && (!sigint_received))
+    if(now - lastinput >= ALARMTIME*1000LL)
+    {
+      sigalarm_received = 1;
+      /* unless the caster stalled and left no room to read */
+      if(queue || ring_room(ring) >= BUFSZ)
+        backlog.open = 0;
+      fprintf(stderr, "ERROR: more than %d seconds no activity\n", ALARMTIME);
+      break;
+    }
+
+    /*** control connection ***/
+    if(outmode == RTSP && now - laststate >= 15000)
+    {
+      int i = snprintf(buffer, sizeof(buffer),
+      "GET_PARAMETER rtsp://%s%s/%s RTSP/1.0\r\n"
+      "CSeq: %d\r\n"
+      "Session: %u\r\n"
+      "\r\n",
+      casterouthost, rtsp_extension,  mountpoint,  udp_cseq++, rtpssrc);
+      if(i > (int)sizeof(buffer) || i < 0)
       {
-        perror("WARNING: reading input failed");
-        return;
+        fprintf(stderr, "Requested data too long\n");
+        break;
       }
-      /* we can compare the whole buffer, as the additional bytes
-         remain unchanged */
-      if(inputmode == SISNET && sisnet <= 30 &&
-      !memcmp(sisnetbackbuffer, buffer, sizeof(sisnetbackbuffer)))
+      else if(send(socket_tcp, buffer, (size_t)i, 0) != i)
       {
-        nBufferBytes = 0;
+        perror("send");
+        break;
       }
+      laststate = now;
     }
-    if(nBufferBytes < 0)
-      return;
-    /**  send data ***/
-    if((nBufferBytes)  && (outmode == NTRIP1)) /*** Ntrip-Version 1.0 ***/
+    else if(outmode == UDP && now - rtpalive > 60000)
     {
-      int i;
-      if((i = send(sock, buffer, (size_t)nBufferBytes, MSG_DONTWAIT))
-      != nBufferBytes)
-      {
-        if(i < 0)
-        {
-          if(errno != EAGAIN)
-          {
-            perror("WARNING: could not send data to Destination caster");
-            return;
-          }
-        }
-        else if(i)
-        {
-          memmove(buffer, buffer+i, (size_t)(nBufferBytes-i));
-          nBufferBytes -= i;
-        }
-      }else
-      {
-        nBufferBytes = 0;
-      }
+      fprintf(stderr, "Timeout\n");
+      break;
     }
-    else if((nBufferBytes)  && (outmode == UDP))
+    if((events & WAIT_CTL) && outmode == RTSP)
     {
-      char rtpbuf[1592];
-      int i;
-      int ct = time(0);
-      udp_tim += (ct-udp_init)*1000000/TIME_RESOLUTION;
-      udp_init = ct;
-      rtpbuf[0] = (2<<6);
-      rtpbuf[1] = 96;
-      rtpbuf[2] = (udp_seq>>8)&0xFF;
-      rtpbuf[3] = (udp_seq)&0xFF;
-      rtpbuf[4] = (udp_tim>>24)&0xFF;
-      rtpbuf[5] = (udp_tim>>16)&0xFF;
-      rtpbuf[6] = (udp_tim>>8)&0xFF;
-      rtpbuf[7] = (udp_tim)&0xFF;
-      rtpbuf[8] = (rtpssrc>>24)&0xFF;
-      rtpbuf[9] = (rtpssrc>>16)&0xFF;
-      rtpbuf[10] = (rtpssrc>>8)&0xFF;
-      rtpbuf[11] = (rtpssrc)&0xFF;
-      ++udp_seq;
-      memcpy(rtpbuf+12, buffer, nBufferBytes);
-      if((i = send(socket_tcp, rtpbuf, (size_t)nBufferBytes+12, MSG_DONTWAIT))
-      != nBufferBytes+12)
+      /* ignore RTSP server replies */
+      int r;
+      if((r=recv(socket_tcp, buffer, sizeof(buffer), 0)) < 0)
       {
+#ifdef WINDOWSVERSION
+        if(WSAGetLastError() != WSAEWOULDBLOCK)
+#else /* WINDOWSVERSION */
         if(errno != EAGAIN)
+#endif /* WINDOWSVERSION */
         {
-          perror("WARNING: could not send data to Destination caster");
-          return;
+          fprintf(stderr, "Control connection closed\n");
+          break;
         }
       }
-      else
-        nBufferBytes = 0;
-      i = recv(socket_tcp, rtpbuf, sizeof(rtpbuf), 0);
-      if(i >= 12 && (unsigned char)rtpbuf[0] == (2 << 6) && rtpssrc ==
-      (unsigned int)(((unsigned char)rtpbuf[8]<<24)+((unsigned char)rtpbuf[9]<<16)
-      +((unsigned char)rtpbuf[10]<<8)+(unsigned char)rtpbuf[11]))
+      else if(!r)
+      {
+        fprintf(stderr, "Control connection read error\n");
+        break;
+      }
+    }
+    else if((events & WAIT_CTL) && outmode == UDP)
+    {
+      unsigned char rtpbuf[1592];
+      int i = recv(socket_tcp, (char *)rtpbuf, sizeof(rtpbuf), 0);
+      if(i >= 12 && rtpbuf[0] == (2 << 6) && rtpssrc ==
+      (unsigned int)((rtpbuf[8]<<24)+(rtpbuf[9]<<16)+(rtpbuf[10]<<8)
+      +rtpbuf[11]))
       {
         if(rtpbuf[1] == 96)
-            rtptime = time(0);
+          rtpalive = now;
         else if(rtpbuf[1] == 98)
         {
-            fprintf(stderr, "Connection end\n");
-            return;
+          fprintf(stderr, "Connection end\n");
+          break;
         }
       }
-      else if(time(0) > rtptime+60)
+    }
+
+    progress = 0;
+    if(queue)
+    {
+#ifndef WINDOWSVERSION
+      /*** taking data from the input thread ****/
+      if(ring_used(ring))
+        lastinput = now;
+      else if(queue->done)
       {
-        fprintf(stderr, "Timeout\n");
-        return;
+        fprintf(stderr, "WARNING: input thread has ended\n");
+        backlog.open = 0;
+        break;
       }
+#endif
     }
-    /*** Ntrip-Version 2.0 HTTP/1.1 ***/
-    else if((nBufferBytes)  && (outmode == HTTP))
+    else if(inputmode == SISNET && sisnet <= 30 && !sisnetsent)
     {
-      int i, nChunkBytes, j = 1;
-      nChunkBytes = snprintf(szSendBuffer, sizeof(szSendBuffer),"%x\r\n",
-      nBufferBytes);
-      send(sock, szSendBuffer, nChunkBytes, MSG_DONTWAIT);
-      if((i = send(sock, buffer, (size_t)nBufferBytes, MSG_DONTWAIT))
-      != nBufferBytes)
+      /* a somewhat higher rate than 1 second to get really each block */
+      /* means we need to skip double blocks sometimes */
+      if(now >= sisnetnext)
       {
-        if(i < 0)
-        {
-          if(errno != EAGAIN)
-          {
-            perror("WARNING: could not send data to Destination caster");
-            return;
-          }
-        }
-        else if(i)
+        int i = (sisnet >= 30 ? 5 : 3);
+        if((send(gps_socket, "MSG\r\n", i, 0)) != i)
         {
-          while(j>0)
-          {
-            j = send(sock, buffer, (size_t)BUFSZ, MSG_DONTWAIT);
-          }
+          perror("WARNING: sending SISNeT data request failed");
+          backlog.open = 0;
+          break;
         }
-      }
-      else
-      {
-        send(sock, "\r\n", strlen("\r\n"), MSG_DONTWAIT);
-        nBufferBytes = 0;
+        sisnetsent = 1;
       }
     }
-    /*** Ntrip-Version 2.0 RTSP(TCP) / RTP(UDP) ***/
-    else if((nBufferBytes)  && (outmode == RTSP))
+    /* read only what is there, but don't wait while data is pending; a
+       replay is read when it is due */
+    else if(((events & WAIT_IN) || (replay.active && !inputend
+    && now >= inputretry)) && ring_room(ring) >= BUFSZ)
     {
-      time_t ct;
-      int r;
-      char rtpbuffer[BUFSZ+12];
-      int i, j;
-      gettimeofday(&now, NULL);
-      /* RTP data packet generation*/
-      if(isfirstpacket){
-        rtpseq = rand();
-        rtptime = rand();
-        last = now;
-        isfirstpacket = 0;
+      struct iovec iov[2];
+      int          cnt = ring_space(ring, iov);
+
+      if(inputmode == SISNET && sisnet <= 30)
+      {
+        /* the blocks are compared, so they go to buffer first */
+        memcpy(sisnetbackbuffer, buffer, sizeof(sisnetbackbuffer));
+        iov[0].iov_base = buffer;
+        iov[0].iov_len = sizeof(buffer);
+        cnt = 1;
+        sisnetsent = 0;
+        sisnetnext = now + 700;
       }
+      /*** receiving data ****/
+      if(replay.active)
+        nBufferBytes = replay_read(&replay, iov, cnt, now);
       else
+#ifndef WINDOWSVERSION
+      nBufferBytes = readv(input_fd(), iov, cnt);
+#else
+      if(inputmode == SERIAL)
       {
-        ++rtpseq;
-        sendtimediff = (((now.tv_sec - last.tv_sec)*1000000)
-        + (now.tv_usec - last.tv_usec));
-        rtptime += sendtimediff/TIME_RESOLUTION;
-      }
-      rtpbuffer[0] = (RTP_VERSION<<6);
-      /* padding, extension, csrc are empty */
-      rtpbuffer[1] = 96;
-      /* marker is empty */
-      rtpbuffer[2] = rtpseq>>8;
-      rtpbuffer[3] = rtpseq;
-      rtpbuffer[4] = rtptime>>24;
-      rtpbuffer[5] = rtptime>>16;
-      rtpbuffer[6] = rtptime>>8;
-      rtpbuffer[7] = rtptime;
-      rtpbuffer[8] = rtpssrc>>24;
-      rtpbuffer[9] = rtpssrc>>16;
-      rtpbuffer[10] = rtpssrc>>8;
-      rtpbuffer[11] = rtpssrc;
-      for(j=0; j<nBufferBytes; j++) {rtpbuffer[12+j] = buffer[j];}
-      last.tv_sec  = now.tv_sec;
-      last.tv_usec = now.tv_usec;
-      if ((i = sendto(sock, rtpbuffer, 12 + nBufferBytes, 0, pcasterRTP,
-      length)) != (nBufferBytes + 12))
-      {
-        if(i < 0)
-        {
-          if(errno != EAGAIN)
-          {
-            perror("WARNING: could not send data to Destination caster");
-            return;
-          }
-        }
-        else if(i)
+        DWORD nRead = 0;
+        if(!ReadFile(gps_serial, iov[0].iov_base, iov[0].iov_len, &nRead,
+        NULL))
         {
-          memmove(buffer, buffer+(i-12), (size_t)(nBufferBytes-(i-12)));
-          nBufferBytes -= i-12;
+          fprintf(stderr,"ERROR: reading serial input failed\n");
+          backlog.open = 0;
+          break;
         }
+        nBufferBytes = (int)nRead;
       }
+      else if(inputmode == INFILE)
+        nBufferBytes = read(gps_file, iov[0].iov_base, iov[0].iov_len);
       else
+        nBufferBytes = recv(gps_socket, iov[0].iov_base, iov[0].iov_len, 0);
+#endif
+      if(!nBufferBytes && ((inputmode == INFILE && !replay.active)
+      || inputmode == SERIAL))
       {
-        nBufferBytes = 0;
+        /* the file may still grow or the device come back, look again
+           later */
+        fprintf(stderr, "WARNING: no data received from input\n");
+        inputretry = now + 3000;
       }
-      ct = time(0);
-      if(ct-laststate > 15)
+      else if(!nBufferBytes && inputmode != UDPSOCKET)
       {
-        i = snprintf(buffer, sizeof(buffer),
-        "GET_PARAMETER rtsp://%s%s/%s RTSP/1.0\r\n"
-        "CSeq: %d\r\n"
-        "Session: %u\r\n"
-        "\r\n",
-        casterouthost, rtsp_extension,  mountpoint,  udp_cseq++, rtpssrc);
-        if(i > (int)sizeof(buffer) || i < 0)
-        {
-          fprintf(stderr, "Requested data too long\n");
-          return;
-        }
-        else if(send(socket_tcp, buffer, (size_t)i, 0) != i)
+        fprintf(stderr, "WARNING: no data received from input\n");
+        /* the input is closed, send what is left first */
+        inputend = 1;
+        backlog.open = 0;
+      }
+      else if(nBufferBytes < 0 && replay.active && errno == EAGAIN)
+      {
+        /* nothing is due yet, the input isn't idle though */
+        inputretry = (long long)replay.due + 1;
+        lastinput = now;
+      }
+      else if(nBufferBytes < 0)
+      {
+#ifndef WINDOWSVERSION
+        if(errno != EAGAIN && errno != EINTR)
+#endif
         {
-          perror("send");
-          return;
+          if(!sigint_received)
+            perror("WARNING: reading input failed");
+          backlog.open = 0;
+          break;
         }
-        laststate = ct;
       }
-      /* ignore RTSP server replies */
-      if((r=recv(socket_tcp, buffer, sizeof(buffer), 0)) < 0)
+      /* we can compare the whole buffer, as the additional bytes
+         remain unchanged */
+      else if(inputmode == SISNET && sisnet <= 30)
       {
-#ifdef WINDOWSVERSION
-        if(WSAGetLastError() != WSAEWOULDBLOCK)
-#else /* WINDOWSVERSION */
-        if(errno != EAGAIN)
-#endif /* WINDOWSVERSION */
+        if(memcmp(sisnetbackbuffer, buffer, sizeof(sisnetbackbuffer)))
+          rtcm_input(ring, &backlog.framer,
+          ring_copy(ring, buffer, nBufferBytes));
+        lastinput = now;
+      }
+      else
+      {
+        rtcm_input(ring, &backlog.framer, (size_t)nBufferBytes);
+        lastinput = now;
+      }
+    }
+
+    /* input older than -w is of no use to the rovers any more, a chunk
+       which is announced already goes out whole */
+    expired = 0;
+    if(maxage && !chunk.active && !regularfile && !replay.active)
+      expired = backlog_expire(ring, now - maxage);
+
+    /**  send data ***/
+    if(queue_pending(ring, &chunk) && (!blocked || (events & WAIT_OUT)))
+    {
+      int i;
+      /*** Ntrip-Version 1.0 and Ntrip-Version 2.0 HTTP/1.1 chunked ***/
+      if(outmode == NTRIP1 || outmode == HTTP)
+        i = send_queue(sock, outmode, ring, &chunk);
+      /*** Ntrip-Version 2.0 UDP ***/
+      else if(outmode == UDP)
+      {
+        int ct = time(0);
+        udp_tim += (ct-udp_init)*1000000/TIME_RESOLUTION;
+        udp_init = ct;
+        i = send_rtp(socket_tcp, 0, 0, ring, &udp_seq, udp_tim, rtpssrc);
+      }
+      /*** Ntrip-Version 2.0 RTSP(TCP) / RTP(UDP) ***/
+      else
+      {
+        gettimeofday(&tnow, NULL);
+        /* RTP data packet generation*/
+        if(isfirstpacket){
+          rtpseq = rand();
+          rtptime = rand();
+          last = tnow;
+          isfirstpacket = 0;
+        }
+        else
         {
-          fprintf(stderr, "Control connection closed\n");
-          return;
+          sendtimediff = (((tnow.tv_sec - last.tv_sec)*1000000)
+          + (tnow.tv_usec - last.tv_usec));
+          rtptime += sendtimediff/TIME_RESOLUTION;
         }
+        last.tv_sec  = tnow.tv_sec;
+        last.tv_usec = tnow.tv_usec;
+        i = send_rtp(sock, pcasterRTP, length, ring, &rtpseq, rtptime, rtpssrc);
       }
-      else if(!r)
+      if(i < 0)
       {
-        fprintf(stderr, "Control connection read error\n");
-        return;
+        perror("WARNING: could not send data to Destination caster");
+        break;
       }
+      progress = i;
+      if(progress)
+        metrics_sent(now);
+      /* not all was taken, so wait until the caster takes more */
+      blocked = queue_pending(ring, &chunk);
+    }
+#ifndef WINDOWSVERSION
+    if(queue && (progress || expired))
+      queue_consumed(queue);
+#endif
+    if(inputend && !queue_pending(ring, &chunk))
+      break;
+
+    /*** waiting for the next event ***/
+    metrics.queued = ring_used(ring);
+    if(queue)
+#ifndef WINDOWSVERSION
+      waitinput = queue_sleep(queue);
+#else
+      waitinput = 0;
+#endif
+    else if(inputmode == SISNET && sisnet <= 30)
+      waitinput = sisnetsent;
+    else if(replay.active)
+      waitinput = 0;
+    else
+      waitinput = !inputend && now >= inputretry
+      && ring_room(ring) >= BUFSZ;
+    next = lastinput + ALARMTIME*1000LL;
+    if(!queue && !inputend && now < inputretry
+    && inputretry < next)
+      next = inputretry;
+    if(!queue && replay.active && !inputend && ring_room(ring) >= BUFSZ
+    && inputretry < next)
+      next = inputretry;
+    if(!queue && inputmode == SISNET && sisnet <= 30 && !sisnetsent
+    && sisnetnext < next)
+      next = sisnetnext;
+    if(outmode == RTSP && laststate + 15000 < next)
+      next = laststate + 15000;
+    else if(outmode == UDP && rtpalive + 60001 < next)
+      next = rtpalive + 60001;
+    now = msec();
+    /* the input thread may have queued data since the last send */
+    if(queue_pending(ring, &chunk) && !blocked)
+      events = 0;
+    else
+      events = wait_events(waitinput, queue,
+      blocked ? (outmode == UDP ? socket_tcp : sock) : INVALID_SOCKET,
+      ctlsock, next > now ? (int)(next - now) : 0);
+#ifndef WINDOWSVERSION
+    if(queue && waitinput)
+    {
+      queue_awake(queue);
+      events |= WAIT_IN;
     }
-    if(send_recv_success == 3) reconnect_sec = 1;
+#endif
+  }
+  if(!queue)
+  {
+    rtcm_status(&backlog.framer);
+    lat_status(ring->lat, 0);
   }
+  if(maxage)
+    fprintf(stderr, "%llu bytes older than %d ms dropped\n", metrics.expired,
+    maxage);
+#ifndef WINDOWSVERSION
+  /* protects the connection setup again */
+  alarm(ALARMTIME);
+#endif
   return;
 }
 
@@ -1926,7 +2671,53 @@ void usage(int rc, char *name)
   fprintf(stderr, "                         the program in a proxy server protected LAN, optional\n");
   fprintf(stderr, "    -R <maxDelay>        Reconnect mechanism with maximum delay between reconnect\n");
   fprintf(stderr, "                         attemts in seconds, default: no reconnect activated,\n");
-  fprintf(stderr, "                         optional\n\n");
+  fprintf(stderr, "                         optional\n");
+  fprintf(stderr, "    -C <ConfigFile>      Daemon mode: run all streams of the config file from\n");
+  fprintf(stderr, "                         one process, other options are ignored, optional\n");
+  fprintf(stderr, "    -T <Transfer>        Transfer method, loop = one thread reads and sends,\n");
+  fprintf(stderr, "                         thread = separate input thread, splice = kernel\n");
+  fprintf(stderr, "                         forwarding for -O 3 (Linux), uring = io_uring for\n");
+  fprintf(stderr, "                         -O 1 and 3 (make IO_URING=1), default: loop, optional\n");
+  fprintf(stderr, "    -Q <QueueSize>       Input queue size in bytes, rounded up to a power of 2,\n");
+  fprintf(stderr, "                         default: %d, optional\n", QUEUESZ);
+  fprintf(stderr, "    -K <Seconds>         Maximum age of the input which is kept in the queue\n");
+  fprintf(stderr, "                         while the caster is reconnected (-R), the input stays\n");
+  fprintf(stderr, "                         open, 0 = send only new input, default: 10, optional\n");
+  fprintf(stderr, "    -r <RtcmMode>        RTCM 3 input framing, none = forward as read,\n");
+  fprintf(stderr, "                         check = forward only whole frames with a valid\n");
+  fprintf(stderr, "                         CRC-24Q, align = check and cut chunks and RTP\n");
+  fprintf(stderr, "                         packets only between frames, default: none,\n");
+  fprintf(stderr, "                         optional\n");
+  fprintf(stderr, "    -A <TypeList>        Forward only these RTCM 3 message types, e.g.\n");
+  fprintf(stderr, "                         1005,1033,1074-1127, optional\n");
+  fprintf(stderr, "    -X <TypeList>        Drop these RTCM 3 message types, optional\n");
+  fprintf(stderr, "    -L <Type:Seconds>    Forward the types at most once per interval,\n");
+  fprintf(stderr, "                         ephemerides once per satellite, e.g.\n");
+  fprintf(stderr, "                         1005:10,1033:10,1019-1020:30, optional\n");
+  fprintf(stderr, "    -Z <Seconds>         Forward only observation epochs on multiples of\n");
+  fprintf(stderr, "                         this interval, e.g. 1 for 10 Hz -> 1 Hz, optional\n");
+  fprintf(stderr, "    -S <[Address:]Port>  Serve Prometheus metrics on http://Address:Port/\n");
+  fprintf(stderr, "                         metrics, default address: 127.0.0.1, optional\n");
+  fprintf(stderr, "    -G <Host[:Port][/Mount]> Hot standby caster for -O 1 and 3, kept connected\n");
+  fprintf(stderr, "                         and taking over the upload at once when the\n");
+  fprintf(stderr, "                         destination caster fails, default port and\n");
+  fprintf(stderr, "                         mountpoint: those of -p and -m, optional\n");
+  fprintf(stderr, "    -o                   TCP Fast Open, the upload request goes with the SYN\n");
+  fprintf(stderr, "                         to casters which handed out a cookie, optional\n");
+  fprintf(stderr, "    -k <Seconds>         The caster connection counts as dead when sent data\n");
+  fprintf(stderr, "                         or keepalive probes stay unacknowledged this long,\n");
+  fprintf(stderr, "                         0 = system defaults, default: 10, optional\n");
+  fprintf(stderr, "    -g                   Gather small sends to the caster into fewer packets\n");
+  fprintf(stderr, "                         (Nagle's algorithm), default: sent at once, optional\n");
+  fprintf(stderr, "    -w <Milliseconds>    Maximum age of the input while the caster lags,\n");
+  fprintf(stderr, "                         older data is dropped unsent in whole frames,\n");
+  fprintf(stderr, "                         turns on -r check, default: 0 = no limit,\n");
+  fprintf(stderr, "                         optional\n");
+  fprintf(stderr, "    -t <Speed>[,loop]    Replay the file input (-M 3) at its recorded pace\n");
+  fprintf(stderr, "                         times Speed, max = as fast as possible; captures\n");
+  fprintf(stderr, "                         of fakecaster -c or RTCM 3 by its epochs, loop =\n");
+  fprintf(stderr, "                         start over at the end, default: as fast as the\n");
+  fprintf(stderr, "                         caster takes it, optional\n\n");
   fprintf(stderr, "    -M <InputMode> Sets the input mode (1 = Serial Port, 2 = IP server,\n");
   fprintf(stderr, "       3 = File, 4 = SISNeT Data Server, 5 = UDP server, 6 = NTRIP Caster),\n");
   fprintf(stderr, "       mandatory\n\n");
@@ -2026,6 +2817,15 @@ static void handle_sigpipe(int sig)
 {
   sigpipe_received = 1;
 }
+
+#ifdef __GNUC__
+static void handle_sigusr1(int sig __attribute__((__unused__)))
+#else /* __GNUC__ */
+static void handle_sigusr1(int sig)
+#endif /* __GNUC__ */
+{
+  sigusr1_received = 1;
+}
 #endif /* WINDOWSVERSION */
 
 static void setup_signal_handler(int sig, void (*handler)(int))
@@ -2121,6 +2921,43 @@ static int send_to_caster(char *input, sockettype socket, int input_size)
   return send_error;
 }/* send_to_caster */
 
+/* receive the reply to the upload request; the first one after the connect
+   at *connstart gives the time to first byte and tells whether the caster
+   took the request with the SYN (-o) */
+static int caster_reply(sockettype s, char *buf, int size,
+long long *connstart)
+{
+  int n = recv(s, buf, size, 0);
+
+  if(n > 0 && *connstart)
+  {
+    metrics.ttfb = msec() - *connstart;
+    *connstart = 0;
+#if defined(TCP_FASTOPEN_CONNECT) && defined(TCPI_OPT_SYN_DATA)
+    if(fastopen)
+    {
+      struct tcp_info ti;
+      socklen_t       len = sizeof(ti);
+      struct timeval  tv = {0, 0};
+
+      if(!getsockopt(s, IPPROTO_TCP, TCP_INFO, &ti, &len))
+      {
+        if(ti.tcpi_options & TCPI_OPT_SYN_DATA)
+          ++metrics.fastopen_syn;
+        else
+          ++metrics.fastopen_handshake;
+        fprintf(stderr, "TCP Fast Open: request sent %s, reply after %lld "
+        "ms\n", ti.tcpi_options & TCPI_OPT_SYN_DATA ? "with the SYN"
+        : "after the handshake", metrics.ttfb);
+      }
+      /* see resolve_connect() */
+      setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+#endif
+  }
+  return n;
+} /* caster_reply */
+
 
 /********************************************************************
  * reconnect                                                        *
@@ -2128,10 +2965,14 @@ static int send_to_caster(char *input, sockettype socket, int input_size)
 int reconnect(int rec_sec, int rec_sec_max)
 {
   fprintf(stderr,"reconnect in <%d> seconds\n\n", rec_sec);
+  ++metrics.reconnects;
   rec_sec *= 2;
   if (rec_sec > rec_sec_max) rec_sec = rec_sec_max;
 #ifndef WINDOWSVERSION
-  sleep(rec_sec);
+  if(backlog.open)
+    backlog_wait(rec_sec);
+  else
+    sleep(rec_sec);
   sigpipe_received = 0;
 #else
   Sleep(rec_sec*1000);
@@ -2142,72 +2983,90 @@ int reconnect(int rec_sec, int rec_sec_max)
 
 
 /********************************************************************
- * close session                                                    *
+ * close input                                                      *
 *********************************************************************/
-static void close_session(const char *caster_addr, const char *mountpoint,
-int session, char *rtsp_ext, int fallback)
+/* closes the input and drops what was kept of it, see backlog_wait() */
+static void close_input(void)
 {
-  int  size_send_buf;
-  char send_buf[BUFSZ];
-
-  if(!fallback)
+#ifndef WINDOWSVERSION
+  if(backlog.queue)
+  {
+    queue_stop(backlog.queue);
+    backlog.queue = 0;
+  }
+#endif
+  ring_free(&backlog.ring);
+  backlog.open = 0;
+  metrics.queued = 0;
+  if((gps_socket != INVALID_SOCKET) &&
+     ((inputmode == TCPSOCKET) || (inputmode == UDPSOCKET) ||
+     (inputmode == CASTER)    || (inputmode == SISNET)))
   {
-    if((gps_socket != INVALID_SOCKET) &&
-       ((inputmode == TCPSOCKET) || (inputmode == UDPSOCKET) ||
-       (inputmode == CASTER)    || (inputmode == SISNET)))
+    if(closesocket(gps_socket) == -1)
     {
-      if(closesocket(gps_socket) == -1)
-      {
-        perror("ERROR: close input device ");
-        exit(0);
-      }
-      else
-      {
-        gps_socket = -1;
+      perror("ERROR: close input device ");
+      exit(0);
+    }
+    else
+    {
+      gps_socket = -1;
 #ifndef NDEBUG
-        fprintf(stderr, "close input device: successful\n");
+      fprintf(stderr, "close input device: successful\n");
 #endif
-      }
     }
-    else if((gps_serial != INVALID_HANDLE_VALUE) && (inputmode == SERIAL))
-    {
+  }
+  else if((gps_serial != INVALID_HANDLE_VALUE) && (inputmode == SERIAL))
+  {
 #ifndef WINDOWSVERSION
-      if(close(gps_serial) == INVALID_HANDLE_VALUE)
-      {
-        perror("ERROR: close input device ");
-        exit(0);
-      }
+    if(close(gps_serial) == INVALID_HANDLE_VALUE)
+    {
+      perror("ERROR: close input device ");
+      exit(0);
+    }
 #else
-      if(!CloseHandle(gps_serial))
-      {
-        fprintf(stderr, "ERROR: close input device ");
-        exit(0);
-      }
+    if(!CloseHandle(gps_serial))
+    {
+      fprintf(stderr, "ERROR: close input device ");
+      exit(0);
+    }
 #endif
-      else
-      {
-        gps_serial = INVALID_HANDLE_VALUE;
+    else
+    {
+      gps_serial = INVALID_HANDLE_VALUE;
 #ifndef NDEBUG
-        fprintf(stderr, "close input device: successful\n");
+      fprintf(stderr, "close input device: successful\n");
 #endif
-      }
     }
-    else if((gps_file != -1) && (inputmode == INFILE))
+  }
+  else if((gps_file != -1) && (inputmode == INFILE))
+  {
+    if(close(gps_file) == -1)
     {
-      if(close(gps_file) == -1)
-      {
-        perror("ERROR: close input device ");
-        exit(0);
-      }
-      else
-      {
-        gps_file = -1;
+      perror("ERROR: close input device ");
+      exit(0);
+    }
+    else
+    {
+      gps_file = -1;
 #ifndef NDEBUG
-        fprintf(stderr, "close input device: successful\n");
+      fprintf(stderr, "close input device: successful\n");
 #endif
-      }
     }
   }
+} /* close_input */
+
+
+/********************************************************************
+ * close session                                                    *
+*********************************************************************/
+static void close_session(const char *caster_addr, const char *mountpoint,
+int session, char *rtsp_ext, int fallback)
+{
+  int  size_send_buf;
+  char send_buf[BUFSZ];
+
+  if(!fallback)
+    close_input();
 
   if(socket_udp != INVALID_SOCKET)
   {
@@ -2261,3 +3120,4403 @@ int session, char *rtsp_ext, int fallback)
     }
   }
 } /* close_session */
+
+
+/********************************************************************
+ * mode names                                                       *
+*********************************************************************/
+/* returns 0 for an invalid input mode */
+static int parse_inputmode(const char *mode)
+{
+  int m;
+
+  if(!strcmp(mode, "serial"))         m = SERIAL;
+  else if(!strcmp(mode, "tcpsocket")) m = TCPSOCKET;
+  else if(!strcmp(mode, "file"))      m = INFILE;
+  else if(!strcmp(mode, "sisnet"))    m = SISNET;
+  else if(!strcmp(mode, "udpsocket")) m = UDPSOCKET;
+  else if(!strcmp(mode, "caster"))    m = CASTER;
+  else m = atoi(mode);
+  return (m <= 0 || m >= LAST) ? 0 : m;
+} /* parse_inputmode */
+
+/* returns 0 for an invalid output mode */
+static int parse_outputmode(const char *mode)
+{
+  int m;
+
+  if (!strcmp(mode,"n") || !strcmp(mode,"ntrip1"))   m = NTRIP1;
+  else if(!strcmp(mode,"h") || !strcmp(mode,"http")) m = HTTP;
+  else if(!strcmp(mode,"r") || !strcmp(mode,"rtsp")) m = RTSP;
+  else if(!strcmp(mode,"u") || !strcmp(mode,"udp"))  m = UDP;
+  else m = atoi(mode);
+  return (m <= 0 || m >= END) ? 0 : m;
+} /* parse_outputmode */
+
+
+/********************************************************************
+ * build upload request for NTRIP1 or HTTP output                   *
+*********************************************************************/
+/* returns the snprintf() result, check it against size */
+static int build_caster_request(char *buf, size_t size, int outmode,
+const char *extension, const char *mountpoint, const char *host,
+const char *authorization, const char *password, const char *ntrip_str)
+{
+  if(outmode == NTRIP1)
+  {
+    return snprintf(buf, size,
+      "SOURCE %s %s/%s\r\n"
+      "Source-Agent: %s/%s\r\n\r\n",
+      password, extension, mountpoint, AGENTSTRING, revisionstr);
+  }
+  return snprintf(buf, size,
+    "POST %s/%s HTTP/1.1\r\n"
+    "Host: %s\r\n"
+    "Ntrip-Version: Ntrip/2.0\r\n"
+    "User-Agent: %s/%s\r\n"
+    "Authorization: Basic %s%s%s\r\n"
+    "Connection: close\r\n"
+    "Transfer-Encoding: chunked\r\n\r\n",
+    extension, mountpoint, host, AGENTSTRING,
+    revisionstr, authorization, ntrip_str ? "\r\nNtrip-STR: " : "",
+    ntrip_str);
+} /* build_caster_request */
+
+
+/********************************************************************
+ * host name resolution                                             *
+ *                                                                  *
+ * Host names are looked up with getaddrinfo() by a thread of its   *
+ * own, so a slow resolver never stalls the transfer, and IPv6      *
+ * casters work as well. The addresses are kept for DNSCACHETIME    *
+ * seconds, getaddrinfo() doesn't tell the TTL, and then used on    *
+ * while a new lookup runs in the background. The lookups start     *
+ * when the program starts and when a connection ends, so they run  *
+ * during the reconnect delay and a reconnect finds the addresses.  *
+ * Only the very first connect waits for its lookup. On Windows the *
+ * lookup is done in place.                                         *
+ *                                                                  *
+ * The addresses are connected like RFC 8305 does: non-blocking,    *
+ * alternating between IPv6 and IPv4, the next address starts when  *
+ * the last one didn't answer within CONNECTDELAY, and the first    *
+ * completed handshake wins. A host which doesn't answer at all     *
+ * costs CONNECTTIME instead of the SYN retries of the kernel.      *
+*********************************************************************/
+#ifndef WINDOWSVERSION
+#define RESOLVE_LOCK(r)   pthread_mutex_lock(&(r)->lock)
+#define RESOLVE_UNLOCK(r) pthread_mutex_unlock(&(r)->lock)
+#else
+#define RESOLVE_LOCK(r)
+#define RESOLVE_UNLOCK(r)
+#endif
+
+/* numeric form of an address, for the messages */
+static const char *addr_str(const struct sockaddr_storage *a, socklen_t len)
+{
+  static char buf[INET6_ADDRSTRLEN];
+
+  if(getnameinfo((const struct sockaddr *)a, len, buf, sizeof(buf), 0, 0,
+  NI_NUMERICHOST))
+    strcpy(buf, "?");
+  return buf;
+} /* addr_str */
+
+static unsigned int addr_port(const struct sockaddr_storage *a)
+{
+  return ntohs(a->ss_family == AF_INET6
+  ? ((const struct sockaddr_in6 *)a)->sin6_port
+  : ((const struct sockaddr_in *)a)->sin_port);
+} /* addr_port */
+
+static void addr_setport(struct sockaddr_storage *a, unsigned int port)
+{
+  if(a->ss_family == AF_INET6)
+    ((struct sockaddr_in6 *)a)->sin6_port = htons(port);
+  else
+    ((struct sockaddr_in *)a)->sin_port = htons(port);
+} /* addr_setport */
+
+/* the blocking lookup, returns 0 or the getaddrinfo() error */
+static int resolve_lookup(const char *host, unsigned int port,
+struct hostaddrs *a)
+{
+  struct addrinfo  hints, *res, *ai;
+  char             service[8];
+  int              n;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM; /* the same addresses for datagrams */
+  hints.ai_flags = AI_ADDRCONFIG;
+  snprintf(service, sizeof(service), "%u", port);
+  if((n = getaddrinfo(host, service, &hints, &res)))
+    return n;
+  a->count = 0;
+  for(ai = res; ai && a->count < MAXADDRS; ai = ai->ai_next)
+  {
+    if(ai->ai_addrlen > sizeof(a->addr[0]))
+      continue;
+    memcpy(&a->addr[a->count], ai->ai_addr, ai->ai_addrlen);
+    a->len[a->count++] = (socklen_t)ai->ai_addrlen;
+  }
+  freeaddrinfo(res);
+  return a->count ? 0 : EAI_NONAME;
+} /* resolve_lookup */
+
+#ifndef WINDOWSVERSION
+static void *resolve_thread(void *arg)
+#else
+static void resolve_thread(void *arg)
+#endif
+{
+  struct resolve  *r = arg;
+  struct hostaddrs a;
+  int              n = resolve_lookup(r->host, r->port, &a);
+
+  RESOLVE_LOCK(r);
+  if(!n)
+  {
+    r->addrs = a;
+    r->expires = time(0) + DNSCACHETIME;
+  }
+  else if(r->addrs.count)
+    fprintf(stderr, "WARNING: can't resolve <%s>: %s, the last addresses "
+    "are used\n", r->host, gai_strerror(n));
+  /* a host without addresses is reported by resolve_get() */
+  r->error = r->addrs.count ? 0 : n;
+  r->running = 0;
+  RESOLVE_UNLOCK(r);
+#ifndef WINDOWSVERSION
+  return 0;
+#endif
+} /* resolve_thread */
+
+/* look the host up again, unless its addresses are fresh, a lookup runs
+   already or the last one failed and wasn't reported yet */
+static void resolve_start(struct resolve *r)
+{
+#ifndef WINDOWSVERSION
+  pthread_t      thread;
+  pthread_attr_t attr;
+#endif
+
+  if(!r->host)
+    return;
+  RESOLVE_LOCK(r);
+  if(r->running || r->error || (r->addrs.count && time(0) < r->expires))
+  {
+    RESOLVE_UNLOCK(r);
+    return;
+  }
+  r->running = 1;
+  RESOLVE_UNLOCK(r);
+#ifndef WINDOWSVERSION
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if(pthread_create(&thread, &attr, resolve_thread, r))
+    resolve_thread(r);
+  pthread_attr_destroy(&attr);
+#else
+  resolve_thread(r);
+#endif
+} /* resolve_start */
+
+/* a host to be looked up from now on */
+static void resolve_init(struct resolve *r, const char *host,
+unsigned int port)
+{
+  memset(r, 0, sizeof(*r));
+  r->host = host;
+  r->port = port;
+#ifndef WINDOWSVERSION
+  pthread_mutex_init(&r->lock, 0);
+#endif
+  resolve_start(r);
+} /* resolve_init */
+
+/* the addresses of the host, old ones while a new lookup runs, waits only
+   for the first lookup when wait is set; returns their number, 0 if the
+   host is unknown and -1 while it is still being looked up */
+static int resolve_get(struct resolve *r, struct hostaddrs *a, int wait)
+{
+  int n;
+
+  resolve_start(r);
+  for(;;)
+  {
+    RESOLVE_LOCK(r);
+    if(r->addrs.count || !r->running || !wait || sigint_received)
+      break;
+    RESOLVE_UNLOCK(r);
+#ifndef WINDOWSVERSION
+    poll(0, 0, 20);
+#endif
+  }
+  *a = r->addrs;
+  n = a->count ? a->count : r->running ? -1 : 0;
+  if(!n && r->error)
+  {
+    fprintf(stderr, "WARNING: can't resolve <%s>: %s\n", r->host,
+    gai_strerror(r->error));
+    r->error = 0;
+  }
+  RESOLVE_UNLOCK(r);
+  return n;
+} /* resolve_get */
+
+/* -o: the connect only takes the address, the first send carries the upload
+   request with the SYN if the caster handed out a Fast Open cookie before;
+   without one the kernel asks for it and does the usual handshake */
+static void fastopen_set(sockettype s)
+{
+#ifdef TCP_FASTOPEN_CONNECT
+  int on = 1;
+
+  if(setsockopt(s, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, (const char *)&on,
+  sizeof(on)) < 0)
+  {
+    perror("WARNING: TCP Fast Open not available");
+    fastopen = 0;
+  }
+#else
+  fprintf(stderr, "WARNING: TCP Fast Open is not supported on this system\n");
+  fastopen = 0;
+#endif
+} /* fastopen_set */
+
+/* the caster connection counts as dead when sent data or keepalive probes
+   stay unacknowledged for dead seconds (0 = system defaults), so the send
+   fails and the reconnect starts, even while the input keeps flowing;
+   the data goes out at once unless gather is set; with a maximum age the
+   kernel takes no more than NOTSENTLOWAT unsent bytes, the rest waits in
+   the queue, where backlog_expire() can still drop it */
+static void caster_sockopts(sockettype s, int dead, int gather, int age)
+{
+  int on = !gather;
+
+  setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char *)&on, sizeof(on));
+#ifdef TCP_NOTSENT_LOWAT
+  if(age)
+  {
+    int lowat = NOTSENTLOWAT;
+    setsockopt(s, IPPROTO_TCP, TCP_NOTSENT_LOWAT, (const char *)&lowat,
+    sizeof(lowat));
+  }
+#endif
+  if(!dead)
+    return;
+  on = 1;
+  setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, (const char *)&on, sizeof(on));
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+  {
+    int idle = (dead+1)/2, intvl = dead/6 ? dead/6 : 1, cnt = 3;
+
+    setsockopt(s, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(s, IPPROTO_TCP, TCP_KEEPINTVL, &intvl, sizeof(intvl));
+    setsockopt(s, IPPROTO_TCP, TCP_KEEPCNT, &cnt, sizeof(cnt));
+  }
+#endif
+#ifdef TCP_USER_TIMEOUT
+  {
+    unsigned int ms = dead*1000;
+    setsockopt(s, IPPROTO_TCP, TCP_USER_TIMEOUT, &ms, sizeof(ms));
+  }
+#endif
+} /* caster_sockopts */
+
+/* round trip time, retransmits and unacknowledged bytes of the caster
+   connection for the metrics, at most once a second, and printed */
+#ifndef WINDOWSVERSION
+static void tcp_sample(sockettype s, long long now, int print)
+{
+#ifdef TCP_INFO
+  static long long last;
+  struct tcp_info  ti;
+  socklen_t        len = sizeof(ti);
+
+  if((now - last < 1000 && !print) || s == INVALID_SOCKET)
+    return;
+  last = now;
+  if(getsockopt(s, IPPROTO_TCP, TCP_INFO, &ti, &len) < 0)
+    return; /* e.g. UDP */
+  metrics.rtt = ti.tcpi_rtt;
+  metrics.rttvar = ti.tcpi_rttvar;
+  if(ti.tcpi_total_retrans > metrics.connretrans)
+  {
+    metrics.retransmits += ti.tcpi_total_retrans - metrics.connretrans;
+    metrics.connretrans = ti.tcpi_total_retrans;
+  }
+#ifdef SIOCOUTQNSD
+  {
+    int queued, notsent;
+    if(!ioctl(s, SIOCOUTQ, &queued) && !ioctl(s, SIOCOUTQNSD, &notsent))
+    {
+      metrics.unacked = queued - notsent;
+      metrics.unsent = notsent;
+    }
+  }
+#else
+  metrics.unacked = ti.tcpi_unacked * ti.tcpi_snd_mss;
+#endif
+  if(print)
+    fprintf(stderr, "caster connection: rtt %.1f ms +- %.1f ms, %llu "
+    "retransmits, %lu bytes unacknowledged, %lu unsent\n",
+    metrics.rtt/1000.0, metrics.rttvar/1000.0, metrics.retransmits,
+    metrics.unacked, metrics.unsent);
+#endif
+} /* tcp_sample */
+#endif /* WINDOWSVERSION */
+
+/* the order to connect the addresses in, the families alternate starting
+   with the first one */
+static void resolve_order(const struct hostaddrs *a, int *order)
+{
+  int taken[MAXADDRS], family = a->addr[0].ss_family, i, n;
+
+  memset(taken, 0, sizeof(taken));
+  for(n = 0; n < a->count; ++n)
+  {
+    for(i = 0; i < a->count && (taken[i] || a->addr[i].ss_family != family);
+    ++i)
+      ;
+    if(i == a->count) /* none of this family left */
+      for(i = 0; taken[i]; ++i)
+        ;
+    taken[i] = 1;
+    order[n] = i;
+    family = a->addr[i].ss_family == AF_INET6 ? AF_INET : AF_INET6;
+  }
+} /* resolve_order */
+
+#ifndef WINDOWSVERSION
+/* closes the sockets of a race whose thread is cancelled, see
+   standby_connect() */
+static void resolve_cancel(void *arg)
+{
+  struct pollfd *pfd = arg;
+  int            i;
+
+  for(i = 0; i < MAXADDRS; ++i)
+  {
+    if(pfd[i].fd >= 0)
+      close(pfd[i].fd);
+  }
+} /* resolve_cancel */
+
+/* the race of resolve_connect(), the sockets are kept in pfd, whose
+   slots behind the pending ones are -1 */
+static sockettype resolve_race(const struct hostaddrs *a, int type,
+const char *what, int tfo, int *used, struct pollfd *pfd)
+{
+  int           addr[MAXADDRS], order[MAXADDRS];
+  int           pending = 0, next = 0, win = -1, i, err;
+  socklen_t     len;
+  long long     now = msec(), deadline = now + CONNECTTIME*1000;
+  long long     start = now;
+
+  resolve_order(a, order);
+  while(win < 0 && !sigint_received)
+  {
+    /* the next address joins when the others are silent for too long */
+    if(next < a->count && (!pending || now >= start))
+    {
+      i = order[next++];
+      start = now + CONNECTDELAY;
+      if((pfd[pending].fd = socket(a->addr[i].ss_family, type, 0)) < 0)
+        continue; /* e.g. no IPv6 here */
+      fcntl(pfd[pending].fd, F_SETFL, O_NONBLOCK);
+      if(tfo && type == SOCK_STREAM)
+        fastopen_set(pfd[pending].fd);
+      if(connect(pfd[pending].fd, (const struct sockaddr *)&a->addr[i],
+      a->len[i]) == 0)
+      {
+        win = pending;
+        if(tfo && type == SOCK_STREAM)
+        {
+          /* deferred with a cookie, the first send does the handshake, it
+             gets the time the connect would have had */
+          struct timeval tv = {CONNECTTIME, 0};
+          setsockopt(pfd[win].fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        }
+      }
+      else if(errno != EINPROGRESS)
+      {
+        fprintf(stderr, "WARNING: can't connect %s to %s at port %u: %s\n",
+        what, addr_str(&a->addr[i], a->len[i]), addr_port(&a->addr[i]),
+        strerror(errno));
+        close(pfd[pending].fd);
+        pfd[pending].fd = -1;
+        continue;
+      }
+      pfd[pending].events = POLLOUT;
+      addr[pending++] = i;
+      continue;
+    }
+    if(!pending)
+      break; /* all addresses failed */
+    if(now >= deadline)
+    {
+      fprintf(stderr, "WARNING: can't connect %s to %s at port %u: no "
+      "answer within %d seconds\n", what, addr_str(&a->addr[order[0]],
+      a->len[order[0]]), addr_port(&a->addr[order[0]]), CONNECTTIME);
+      break;
+    }
+    if(poll(pfd, (nfds_t)pending, (int)((next < a->count && start < deadline
+    ? start : deadline) - now)) < 0 && errno != EINTR)
+      break;
+    for(i = 0; i < pending; ++i)
+    {
+      if(!pfd[i].revents)
+        continue;
+      len = sizeof(err);
+      if(getsockopt(pfd[i].fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+        err = errno;
+      if(!err)
+      {
+        win = i;
+        break;
+      }
+      fprintf(stderr, "WARNING: can't connect %s to %s at port %u: %s\n",
+      what, addr_str(&a->addr[addr[i]], a->len[addr[i]]),
+      addr_port(&a->addr[addr[i]]), strerror(err));
+      close(pfd[i].fd);
+      pfd[i] = pfd[--pending];
+      pfd[pending].fd = -1;
+      addr[i--] = addr[pending];
+      start = now; /* a refused address needs no delay for the next */
+    }
+    now = msec();
+  }
+  for(i = 0; i < pending; ++i)
+  {
+    if(i != win)
+    {
+      close(pfd[i].fd);
+      pfd[i].fd = -1;
+    }
+  }
+  if(win < 0)
+    return INVALID_SOCKET;
+  fcntl(pfd[win].fd, F_SETFL, 0);
+  *used = addr[win];
+  return pfd[win].fd;
+} /* resolve_race */
+
+/* connect a new socket of the type to the address which accepts it first,
+   with TCP Fast Open if tfo is set, returns the socket or INVALID_SOCKET,
+   *used is the address */
+static sockettype resolve_connect(const struct hostaddrs *a, int type,
+const char *what, int tfo, int *used)
+{
+  struct pollfd pfd[MAXADDRS];
+  sockettype    s;
+  int           i;
+
+  /* a thread cancelled during the race leaves no sockets behind */
+  for(i = 0; i < MAXADDRS; ++i)
+    pfd[i].fd = -1;
+  pthread_cleanup_push(resolve_cancel, pfd);
+  s = resolve_race(a, type, what, tfo, used, pfd);
+  pthread_cleanup_pop(0);
+  return s;
+} /* resolve_connect */
+#else
+/* connect a new socket of the type to the first of the addresses which
+   accepts it, returns the socket or INVALID_SOCKET, *used is the address */
+static sockettype resolve_connect(const struct hostaddrs *a, int type,
+const char *what, int tfo, int *used)
+{
+  sockettype sock;
+  int        order[MAXADDRS], i;
+
+  resolve_order(a, order);
+  for(i = 0; i < a->count; ++i)
+  {
+    const struct sockaddr_storage *addr = &a->addr[order[i]];
+    if((sock = socket(addr->ss_family, type, 0)) == INVALID_SOCKET)
+      continue; /* e.g. no IPv6 here */
+    if(tfo && type == SOCK_STREAM)
+      fastopen_set(sock);
+    if(connect(sock, (const struct sockaddr *)addr, a->len[order[i]]) == 0)
+    {
+      *used = order[i];
+      return sock;
+    }
+    fprintf(stderr, "WARNING: can't connect %s to %s at port %u\n", what,
+    addr_str(addr, a->len[order[i]]), addr_port(addr));
+    closesocket(sock);
+  }
+  return INVALID_SOCKET;
+} /* resolve_connect */
+#endif
+
+
+/********************************************************************
+ * ring buffer                                                      *
+ *                                                                  *
+ * head and tail count all bytes ever written and read, the buffer  *
+ * size is a power of two, so the index is a simple mask. Data is   *
+ * read into and sent from the ring through iovecs and never moved. *
+ *                                                                  *
+ * One thread may write while another one reads: only the writer    *
+ * changes head and only the reader changes tail, data is published *
+ * by the release store of head and freed by the one of tail.       *
+*********************************************************************/
+#ifdef __GNUC__
+#define RING_LOAD(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define RING_STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define RING_FENCE()     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else /* __GNUC__ */
+#define RING_LOAD(p)     (*(volatile size_t *)(p))
+#define RING_STORE(p, v) (*(volatile size_t *)(p) = (v))
+#define RING_FENCE()
+#endif /* __GNUC__ */
+#define RING_BYTE(r, pos) ((unsigned char)(r)->data[(pos) & ((r)->size-1)])
+
+static int ring_init(struct ringbuf *r, size_t size)
+{
+  size_t s = 1;
+
+  while(s < size) s <<= 1;
+  r->head = r->tail = r->pending = 0;
+  r->framed = r->expire = r->finish = 0;
+  r->frame = 0;
+  r->size = s;
+  r->data = malloc(s);
+  r->lat = 0;
+  return r->data != 0;
+} /* ring_init */
+
+static void ring_free(struct ringbuf *r)
+{
+  free(r->data);
+  r->data = 0;
+  r->lat = 0;
+  r->head = r->tail = r->pending = 0;
+} /* ring_free */
+
+static size_t ring_used(const struct ringbuf *r)
+{
+  return RING_LOAD(&r->head) - RING_LOAD(&r->tail);
+} /* ring_used */
+
+/* bytes to send now, only for the consumer, see backlog_expire() */
+static size_t ring_ready(const struct ringbuf *r)
+{
+  return r->finish ? r->frame - r->tail : ring_used(r);
+} /* ring_ready */
+
+/* free bytes behind the pending ones, only for the producer */
+static size_t ring_room(const struct ringbuf *r)
+{
+  return r->size - (r->head + r->pending - RING_LOAD(&r->tail));
+} /* ring_room */
+
+/* describe up to max stored bytes following the first skip bytes with one
+   or two iovecs */
+static int ring_data(const struct ringbuf *r, size_t skip, struct iovec *iov,
+size_t max)
+{
+  size_t used = RING_LOAD(&r->head) - r->tail;
+  size_t pos = (r->tail + skip) & (r->size-1);
+
+  if(used <= skip) return 0;
+  used -= skip;
+  if(used > max) used = max;
+  iov[0].iov_base = r->data + pos;
+  if(pos + used <= r->size)
+  {
+    iov[0].iov_len = used;
+    return 1;
+  }
+  iov[0].iov_len = r->size - pos;
+  iov[1].iov_base = r->data;
+  iov[1].iov_len = used - iov[0].iov_len;
+  return 2;
+} /* ring_data */
+
+/* describe the free space behind the pending bytes with one or two iovecs */
+static int ring_space(const struct ringbuf *r, struct iovec *iov)
+{
+  size_t space = r->size - (r->head + r->pending - RING_LOAD(&r->tail));
+  size_t pos = (r->head + r->pending) & (r->size-1);
+
+  if(!space) return 0;
+  iov[0].iov_base = r->data + pos;
+  if(pos + space <= r->size)
+  {
+    iov[0].iov_len = space;
+    return 1;
+  }
+  iov[0].iov_len = r->size - pos;
+  iov[1].iov_base = r->data;
+  iov[1].iov_len = space - iov[0].iov_len;
+  return 2;
+} /* ring_space */
+
+static void ring_produce(struct ringbuf *r, size_t n)
+{
+  RING_STORE(&r->head, r->head + n);
+} /* ring_produce */
+
+static void ring_consume(struct ringbuf *r, size_t n)
+{
+  /* the frames are walked before they are given back to the producer */
+  if(r->expire)
+  {
+    while((long)(r->tail + n - r->frame) > 0)
+      r->frame += (((RING_BYTE(r, r->frame+1) & 3) << 8)
+      | RING_BYTE(r, r->frame+2)) + 6;
+    r->finish = 0;
+  }
+  RING_STORE(&r->tail, r->tail + n);
+  metrics.bytes_out += n;
+  if(r->lat)
+    lat_out(r);
+} /* ring_consume */
+
+/* copy into the free space, returns the number of bytes that fit, which
+   still need to be published with rtcm_input() */
+static int ring_copy(struct ringbuf *r, const char *buf, int size)
+{
+  struct iovec iov[2];
+  int          cnt = ring_space(r, iov), i, n = 0;
+
+  for(i = 0; i < cnt && n < size; ++i)
+  {
+    int c = (int)iov[i].iov_len < size-n ? (int)iov[i].iov_len : size-n;
+    memcpy(iov[i].iov_base, buf+n, (size_t)c);
+    n += c;
+  }
+  return n;
+} /* ring_copy */
+
+
+/********************************************************************
+ * ingress to wire latency                                          *
+ *                                                                  *
+ * Each read which publishes bytes to a queue leaves a mark with    *
+ * the new head and the time. When the consumer has sent everything *
+ * up to a mark, the bytes since the previous mark went from input  *
+ * to the caster socket in the time since the mark. The latencies   *
+ * are counted per byte in a histogram with 32 buckets per power of *
+ * 2 microseconds (at most 3% off), like HdrHistogram. The marks    *
+ * are a single producer/single consumer ring like the queue, a     *
+ * full one drops marks, so their bytes count with the next mark.   *
+*********************************************************************/
+/* measure the new, empty queue r into l, which keeps its histogram */
+static void lat_attach(struct ringbuf *r, struct latency *l)
+{
+  l->markhead = l->marktail = l->lastend = r->head;
+  r->lat = l;
+} /* lat_attach */
+
+/* the bytes published since the last mark are in the queue now */
+static void lat_in(struct ringbuf *r)
+{
+  struct latency *l = r->lat;
+  size_t          h;
+
+  if(!l || (h = l->markhead) - RING_LOAD(&l->marktail) == LATMARKS)
+    return;
+  l->mark[h % LATMARKS].end = r->head;
+  l->mark[h % LATMARKS].usec = usec();
+  RING_STORE(&l->markhead, h+1);
+} /* lat_in */
+
+static int lat_bucket(unsigned long long v)
+{
+  int e;
+
+  if(v < (1 << LATSUB))
+    return (int)v;
+  if(v > 0xFFFFFFFFULL)
+    v = 0xFFFFFFFFULL;
+  for(e = LATSUB; v >> (e+1); ++e)
+    ;
+  return ((e-LATSUB+1) << LATSUB) | (int)((v >> (e-LATSUB))
+  & ((1 << LATSUB)-1));
+} /* lat_bucket */
+
+/* highest latency in bucket b */
+static unsigned long long lat_value(int b)
+{
+  int k = b >> LATSUB;
+
+  if(!k)
+    return b;
+  return ((((unsigned long long)1 << LATSUB) | (b & ((1 << LATSUB)-1)))
+  << (k-1)) + ((1ULL << (k-1)) - 1);
+} /* lat_value */
+
+/* count n bytes of the read of mark m as sent now */
+static void lat_count(struct latency *l, const struct latmark *m, size_t n,
+long long *now)
+{
+  long long d;
+
+  if(!*now)
+    *now = usec();
+  d = *now - m->usec;
+  if(d < 0)
+    d = 0;
+  l->bytes[lat_bucket((unsigned long long)d)] += n;
+  l->total += n;
+  l->sum += d/1e6 * (double)n;
+  if((unsigned long)d > l->max)
+    l->max = (unsigned long)d;
+} /* lat_count */
+
+/* account the marks which are completely sent now */
+static void lat_out(struct ringbuf *r)
+{
+  struct latency *l = r->lat;
+  size_t          t = l->marktail, h = RING_LOAD(&l->markhead);
+  long long       now = 0;
+
+  for(; t != h && (long)(r->tail - l->mark[t % LATMARKS].end) >= 0; ++t)
+  {
+    lat_count(l, l->mark + t % LATMARKS, l->mark[t % LATMARKS].end
+    - l->lastend, &now);
+    l->lastend = l->mark[t % LATMARKS].end;
+  }
+  RING_STORE(&l->marktail, t);
+} /* lat_out */
+
+/* drop the n oldest queued bytes, only for the consumer; they count for
+   no latency, the bytes sent before them from the same read still do */
+static void ring_skip(struct ringbuf *r, size_t n)
+{
+  struct latency *l = r->lat;
+  size_t          t, h, sent = r->tail;
+  long long       now = 0;
+
+  RING_STORE(&r->tail, r->tail + n);
+  /* all cuts end between frames */
+  if(r->expire && (long)(r->tail - r->frame) > 0)
+    r->frame = r->tail;
+  r->finish = 0;
+  if(!l)
+    return;
+  for(t = l->marktail, h = RING_LOAD(&l->markhead); t != h; ++t)
+  {
+    if((long)(sent - l->lastend) > 0)
+      lat_count(l, l->mark + t % LATMARKS, sent - l->lastend, &now);
+    if((long)(r->tail - l->mark[t % LATMARKS].end) < 0)
+      break;
+    l->lastend = l->mark[t % LATMARKS].end;
+  }
+  RING_STORE(&l->marktail, t);
+  l->lastend = r->tail;
+} /* ring_skip */
+
+/* latency below which the fraction p of all bytes was sent, in ms */
+static double lat_quantile(const struct latency *l, double p)
+{
+  unsigned long long sum = 0, want = (unsigned long long)(l->total*p);
+  int                b;
+
+  for(b = 0; b < LATBUCKETS - 1; ++b)
+  {
+    sum += l->bytes[b];
+    if(sum > want)
+      break;
+  }
+  return (lat_value(b) < l->max ? lat_value(b) : l->max)/1000.0;
+} /* lat_quantile */
+
+static void lat_status(const struct latency *l, const char *name)
+{
+  if(!l || !l->total)
+    return;
+  fprintf(stderr, "%s%slatency of %llu bytes: p50 %.3f ms, p99 %.3f ms, "
+  "p99.9 %.3f ms, max %.3f ms\n", name ? name : "", name ? ": " : "",
+  l->total, lat_quantile(l, 0.5), lat_quantile(l, 0.99),
+  lat_quantile(l, 0.999), l->max/1000.0);
+} /* lat_status */
+
+
+/********************************************************************
+ * RTCM 3 framing                                                   *
+ *                                                                  *
+ * With "-r check" new input is only published to the output once  *
+ * it forms complete RTCM 3 frames (preamble 0xD3, 6 reserved zero  *
+ * bits, 10 bit length, message, CRC-24Q). The bytes are checked in *
+ * place in the pending part of the ring, which only the reading    *
+ * thread touches. Bytes which don't start a valid frame, like      *
+ * serial line noise, are cut out up to the next preamble, so the   *
+ * caster only gets whole frames with a valid checksum.             *
+ * "-r align" also cuts the output only between frames: every HTTP  *
+ * chunk and RTP packet carries whole frames, so a lost datagram    *
+ * costs exactly the frames in it. NTRIP1 writes end on a frame     *
+ * boundary already, as only whole frames are ever queued.          *
+*********************************************************************/
+#define RTCM3_PREAMBLE 0xD3
+#define RTCM3_MAXLEN   (3+1023+3)
+
+static unsigned long crc24qtab[256];
+
+static void rtcm_crcinit(void)
+{
+  unsigned long i, j, c;
+
+  if(crc24qtab[1])
+    return;
+  for(i = 0; i < 256; ++i)
+  {
+    c = i << 16;
+    for(j = 0; j < 8; ++j)
+      c = (c << 1) ^ ((c & 0x800000) ? 0x1864CFB : 0);
+    crc24qtab[i] = c & 0xFFFFFF;
+  }
+} /* rtcm_crcinit */
+
+static void rtcm_init(struct rtcmframer *f, enum RTCMMODE mode)
+{
+  memset(f, 0, sizeof(*f));
+  f->mode = mode;
+  f->filter = rtcmfilter.active ? &rtcmfilter : 0;
+  if(mode != RTCM_NONE)
+    rtcm_crcinit();
+} /* rtcm_init */
+
+/* table driven CRC-24Q of len bytes at ring position pos */
+static unsigned long rtcm_crc(const struct ringbuf *r, size_t pos, size_t len)
+{
+  const unsigned char *p = (unsigned char *)r->data + (pos & (r->size-1));
+  const unsigned char *end = (unsigned char *)r->data + r->size;
+  unsigned long        crc = 0;
+
+  while(len--)
+  {
+    crc = ((crc << 8) & 0xFFFFFF) ^ crc24qtab[(crc >> 16) ^ *p++];
+    if(p == end)
+      p = (unsigned char *)r->data;
+  }
+  return crc;
+} /* rtcm_crc */
+
+/* move n bytes inside the ring from position from down to position to */
+static void rtcm_move(struct ringbuf *r, size_t to, size_t from, size_t n)
+{
+  size_t mask = r->size-1;
+
+  while(n--)
+    r->data[to++ & mask] = r->data[from++ & mask];
+} /* rtcm_move */
+
+/* nbits bits from bit offset bit of the message at ring position pos */
+static unsigned long rtcm_bits(const struct ringbuf *r, size_t pos, int bit,
+int nbits)
+{
+  unsigned long v = 0;
+
+  for(; nbits--; ++bit)
+    v = (v << 1) | ((RING_BYTE(r, pos + bit/8) >> (7 - bit%8)) & 1);
+  return v;
+} /* rtcm_bits */
+
+/* GPS - UTC, only needed to decimate GLONASS epochs to whole seconds */
+#define LEAPSECONDS 18
+#define GLONASS_OFFSET (3*3600000LL - LEAPSECONDS*1000LL)
+
+/* epoch time of an observation message of len bytes at pos, in
+   milliseconds of the GPS week or day, -1 for other messages */
+static long long rtcm_epoch(const struct ringbuf *r, size_t pos, int type,
+size_t len)
+{
+  int       msm = type >= 1071 && type <= 1137 && type%10 >= 1
+            && type%10 <= 7;
+  long long t;
+
+  if(len < 7)
+    return -1;
+  if(type >= 1009 && type <= 1012)        /* GLONASS, ms of day */
+    t = rtcm_bits(r, pos, 24, 27) - GLONASS_OFFSET;
+  else if(msm && type/10 == 108)          /* GLONASS MSM, after weekday */
+    t = rtcm_bits(r, pos, 27, 27) - GLONASS_OFFSET;
+  else if(msm && type/10 == 112)          /* BeiDou, BDT = GPST - 14 s */
+    t = rtcm_bits(r, pos, 24, 30) + 14000;
+  else if(msm || (type >= 1001 && type <= 1004))
+    t = rtcm_bits(r, pos, 24, 30);
+  else
+    return -1;
+  return t < 0 ? t + 86400000LL : t;
+} /* rtcm_epoch */
+
+/* decide whether the valid frame of len bytes at pos is forwarded, *now
+   is read from the clock when first needed */
+static int rtcm_filter(struct rtcmfilter *f, const struct ringbuf *r,
+size_t pos, size_t len, long long *now)
+{
+  long long          t;
+  int                type, sat = 0, i;
+
+  if(len < 6+2)
+    return 1; /* no message number */
+  type = rtcm_bits(r, pos+3, 0, 12);
+  if((f->allowlist && !(f->allow[type >> 3] & (1 << (type & 7))))
+  || (f->deny[type >> 3] & (1 << (type & 7))))
+    return 0;
+  if(f->decimate && (t = rtcm_epoch(r, pos+3, type, len-6)) >= 0
+  && t % f->decimate)
+    return 0;
+  for(i = 0; i < f->throttles && f->throttle[i].type != type; ++i)
+    ;
+  if(i == f->throttles)
+    return 1;
+  /* ephemerides come one satellite per message */
+  if(len >= 6+3 && (type == 1019 || type == 1020 || type == 1041
+  || type == 1042 || type == 1045 || type == 1046))
+    sat = rtcm_bits(r, pos+3, 12, 6);
+  else if(len >= 6+3 && type == 1044)
+    sat = rtcm_bits(r, pos+3, 12, 4);
+  if(!*now)
+    *now = msec();
+  if(f->throttle[i].last[sat] && *now - f->throttle[i].last[sat]
+  < f->throttle[i].interval)
+    return 0;
+  f->throttle[i].last[sat] = *now;
+  return 1;
+} /* rtcm_filter */
+
+/* Parse the filter option -A, -X or -L with a list "Type[-Type],..." (for
+   -L "Type[-Type]:Seconds,...") or -Z with the epoch interval in seconds.
+   Returns 0 on a syntax error. */
+static int rtcm_parsefilter(struct rtcmfilter *f, int option,
+const char *list)
+{
+  char              *end;
+  long               lo, hi, t;
+  double             sec = 0;
+
+  f->active = 1;
+  if(option == 'Z')
+  {
+    sec = strtod(list, &end);
+    f->decimate = (long long)(sec*1000 + 0.5);
+    return end != list && !*end && f->decimate > 0;
+  }
+  do
+  {
+    lo = hi = strtol(list, &end, 10);
+    if(end == list || lo < 0 || lo > 4095)
+      return 0;
+    if(*end == '-')
+    {
+      list = end+1;
+      hi = strtol(list, &end, 10);
+      if(end == list || hi < lo || hi > 4095)
+        return 0;
+    }
+    if(option == 'L')
+    {
+      if(*end != ':' || (sec = strtod(end+1, &end)) <= 0)
+        return 0;
+    }
+    for(t = lo; t <= hi; ++t)
+    {
+      if(option == 'A')
+      {
+        f->allowlist = 1;
+        f->allow[t >> 3] |= 1 << (t & 7);
+      }
+      else if(option == 'X')
+        f->deny[t >> 3] |= 1 << (t & 7);
+      else if(f->throttles < MAXTHROTTLE)
+      {
+        f->throttle[f->throttles].type = t;
+        f->throttle[f->throttles++].interval = (long long)(sec*1000 + 0.5);
+      }
+      else
+        return 0;
+    }
+    list = end;
+  } while(*list++ == ',');
+  return !list[-1];
+} /* rtcm_parsefilter */
+
+/* n bytes were read behind the pending ones, publish them to the output,
+   without framing directly, else as far as they form valid frames */
+static void rtcm_input(struct ringbuf *r, struct rtcmframer *f, size_t n)
+{
+  size_t    h = r->head, avail, rd = 0, wr = 0, len, i;
+  long long now = 0;
+
+  metrics.bytes_in += n;
+  metrics.lastinput = msec();
+  if(f->mode == RTCM_NONE)
+  {
+    ring_produce(r, n);
+    lat_in(r);
+    return;
+  }
+  /* frames are checked at offset rd from the old head and published at
+     offset wr, they only move down when bytes before them were dropped */
+  avail = r->pending + n;
+  while(avail - rd >= 3)
+  {
+    if(RING_BYTE(r, h+rd) != RTCM3_PREAMBLE || (RING_BYTE(r, h+rd+1) & 0xFC))
+      len = 0;
+    else
+    {
+      len = (((RING_BYTE(r, h+rd+1) & 3) << 8) | RING_BYTE(r, h+rd+2)) + 6;
+      if(avail - rd < len)
+        break; /* incomplete, wait for more input */
+      if(rtcm_crc(r, h+rd, len-3) != (((unsigned long)RING_BYTE(r, h+rd+len-3)
+      << 16) | (RING_BYTE(r, h+rd+len-2) << 8) | RING_BYTE(r, h+rd+len-1)))
+      {
+        ++f->bad;
+        ++metrics.frames_bad;
+        len = 0;
+      }
+    }
+    if(len && f->filter && !rtcm_filter(f->filter, r, h+rd, len, &now))
+    {
+      /* valid, but not wanted */
+      ++f->good;
+      ++f->filtered;
+      ++metrics.frames_good;
+      ++metrics.frames_filtered;
+      f->filteredbytes += len;
+      rd += len;
+      continue;
+    }
+    if(len)
+    {
+      if(wr != rd)
+        rtcm_move(r, h+wr, h+rd, len);
+      ring_produce(r, len);
+      rd += len;
+      wr += len;
+      ++f->good;
+      ++metrics.frames_good;
+      continue;
+    }
+    /* resynchronize at the next preamble */
+    for(i = 1; rd+i < avail && RING_BYTE(r, h+rd+i) != RTCM3_PREAMBLE; ++i)
+      ;
+    rd += i;
+    f->skipped += i;
+  }
+  if(wr != rd)
+    rtcm_move(r, h+wr, h+rd, avail-rd);
+  r->pending = avail-rd;
+  if(wr)
+    lat_in(r);
+} /* rtcm_input */
+
+static void rtcm_status(const struct rtcmframer *f)
+{
+  if(f->mode != RTCM_NONE)
+    fprintf(stderr, "RTCM 3 frames: %lu good, %lu bad, %lu bytes skipped\n",
+    f->good, f->bad, f->skipped);
+  if(f->mode != RTCM_NONE && f->filter)
+    fprintf(stderr, "RTCM 3 filter: %lu frames, %lu bytes dropped\n",
+    f->filtered, f->filteredbytes);
+} /* rtcm_status */
+
+/* Length of the next piece of output behind the first skip stored bytes,
+   at most max bytes. A framed ring only holds whole frames and is sent
+   in whole frames, so the piece ends on a frame boundary; a frame longer
+   than max goes out alone. */
+static size_t rtcm_fit(const struct ringbuf *r, size_t skip, size_t max)
+{
+  size_t used = ring_ready(r), n = 0, pos, len;
+
+  if(!r->framed)
+    return used-skip > max ? max : used-skip;
+  while(skip+n < used)
+  {
+    pos = r->tail+skip+n;
+    len = (((RING_BYTE(r, pos+1) & 3) << 8) | RING_BYTE(r, pos+2)) + 6;
+    if(n && n+len > max)
+      break;
+    n += len;
+  }
+  return n;
+} /* rtcm_fit */
+
+
+/********************************************************************
+ * send queued data to the caster                                   *
+ *                                                                  *
+ * NTRIP1 output sends the ring contents as they are. HTTP output   *
+ * wraps them into chunks; chunk header, payload and trailer go out *
+ * with one sendmsg() and a short send is resumed at the exact byte *
+ * where it stopped, so the chunk framing can never be broken.      *
+ * RTP packets are gathered from their header and the ring, too.    *
+*********************************************************************/
+/* one non-blocking send of all iovecs */
+static int sendiov(sockettype sock, struct iovec *iov, int cnt)
+{
+#ifndef WINDOWSVERSION
+  struct msghdr msg;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = cnt;
+  return sendmsg(sock, &msg, MSG_DONTWAIT|MSG_NOSIGNAL);
+#else
+  int i, n, sum = 0;
+
+  for(i = 0; i < cnt; ++i)
+  {
+    if((n = send(sock, iov[i].iov_base, iov[i].iov_len, 0)) < 0)
+    {
+      if(WSAGetLastError() == WSAEWOULDBLOCK && sum)
+        break;
+      errno = WSAGetLastError() == WSAEWOULDBLOCK ? EAGAIN : EIO;
+      return -1;
+    }
+    sum += n;
+    if(n < (int)iov[i].iov_len)
+      break;
+  }
+  return sum;
+#endif
+} /* sendiov */
+
+/* something still needs to be sent */
+static int queue_pending(const struct ringbuf *q, const struct chunkstate *c)
+{
+  return ring_used(q) || c->active;
+} /* queue_pending */
+
+/* describe the next bytes to send with up to 4 iovecs, starts a new
+   chunk for HTTP output, returns the number of iovecs */
+static int queue_iov(int outmode, const struct ringbuf *q,
+struct chunkstate *c, struct iovec *iov)
+{
+  int cnt = 0;
+
+  if(outmode != HTTP)
+    return ring_data(q, 0, iov, ring_ready(q));
+  if(!c->active)
+  {
+    if(!ring_used(q)) return 0;
+    c->left = rtcm_fit(q, 0, MAXCHUNK);
+    c->headlen = snprintf(c->head, sizeof(c->head), "%x\r\n",
+    (unsigned int)c->left);
+    c->headsent = c->trailsent = 0;
+    c->active = 1;
+  }
+  if(c->headsent < c->headlen)
+  {
+    iov[cnt].iov_base = c->head + c->headsent;
+    iov[cnt++].iov_len = c->headlen - c->headsent;
+  }
+  cnt += ring_data(q, 0, iov+cnt, c->left);
+  iov[cnt].iov_base = (char *)"\r\n" + c->trailsent;
+  iov[cnt++].iov_len = 2 - c->trailsent;
+  return cnt;
+} /* queue_iov */
+
+/* account n sent bytes of the iovecs from queue_iov(), returns the
+   number of payload bytes among them */
+static size_t queue_sent(int outmode, struct ringbuf *q, struct chunkstate *c,
+size_t n)
+{
+  size_t payload;
+
+  if(outmode != HTTP)
+  {
+    ring_consume(q, n);
+    return n;
+  }
+  if(c->headsent < c->headlen)
+  {
+    int h = c->headlen - c->headsent;
+    if(n < (size_t)h) h = n;
+    c->headsent += h;
+    n -= h;
+  }
+  payload = n > c->left ? c->left : n;
+  ring_consume(q, payload);
+  c->left -= payload;
+  n -= payload;
+  c->trailsent += n;
+  if(c->trailsent == 2)
+    c->active = 0;
+  return payload;
+} /* queue_sent */
+
+/* returns number of payload bytes sent or -1 on error, EAGAIN is no error */
+static int send_queue(sockettype sock, int outmode, struct ringbuf *q,
+struct chunkstate *c)
+{
+  struct iovec iov[4];
+  int          cnt, n, i;
+  size_t       len = 0;
+
+  if(!(cnt = queue_iov(outmode, q, c, iov)))
+    return 0;
+  if((n = sendiov(sock, iov, cnt)) < 0)
+  {
+    if(errno == EAGAIN || errno == EWOULDBLOCK)
+      ++metrics.eagain;
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+  }
+  for(i = 0; i < cnt; ++i)
+    len += iov[i].iov_len;
+  ++metrics.writes;
+  if((size_t)n < len)
+    ++metrics.short_writes;
+  return (int)queue_sent(outmode, q, c, (size_t)n);
+} /* send_queue */
+
+/* RTP fixed header, no padding, extension, csrc or marker */
+static void rtp_header(unsigned char *h, int seq, unsigned int tim,
+unsigned int ssrc)
+{
+  h[0] = (RTP_VERSION<<6);
+  h[1] = 96;
+  h[2] = seq>>8;
+  h[3] = seq;
+  h[4] = tim>>24;
+  h[5] = tim>>16;
+  h[6] = tim>>8;
+  h[7] = tim;
+  h[8] = ssrc>>24;
+  h[9] = ssrc>>16;
+  h[10] = ssrc>>8;
+  h[11] = ssrc;
+} /* rtp_header */
+
+/* Send the queued data as RTP packets of up to BUFSZ payload bytes, or
+   of whole RTCM 3 frames from a framed ring (see rtcm_fit()). The
+   header and the payload in the ring are gathered by the kernel, several
+   packets go out with one sendmmsg(). Only data of sent packets is
+   consumed and *seq is advanced for each of them. Returns the number of
+   packets sent or -1 on error, EAGAIN is no error. */
+static int send_rtp(sockettype sock, struct sockaddr *to, socklen_t tolen,
+struct ringbuf *q, int *seq, unsigned int tim, unsigned int ssrc)
+{
+  unsigned char hdr[RTPBATCH][12];
+  struct iovec  iov[RTPBATCH][3];
+  size_t        len[RTPBATCH], off = 0, used = ring_ready(q);
+  int           cnt, iovcnt[RTPBATCH], i, n;
+
+  for(cnt = 0; cnt < RTPBATCH && off < used; ++cnt)
+  {
+    len[cnt] = rtcm_fit(q, off, BUFSZ);
+    rtp_header(hdr[cnt], *seq + cnt, tim, ssrc);
+    iov[cnt][0].iov_base = hdr[cnt];
+    iov[cnt][0].iov_len = 12;
+    iovcnt[cnt] = 1 + ring_data(q, off, iov[cnt]+1, len[cnt]);
+    off += len[cnt];
+  }
+#ifdef HAVE_SENDMMSG
+  {
+    struct mmsghdr msg[RTPBATCH];
+
+    memset(msg, 0, sizeof(msg[0])*cnt);
+    for(i = 0; i < cnt; ++i)
+    {
+      msg[i].msg_hdr.msg_name = to;
+      msg[i].msg_hdr.msg_namelen = to ? tolen : 0;
+      msg[i].msg_hdr.msg_iov = iov[i];
+      msg[i].msg_hdr.msg_iovlen = iovcnt[i];
+    }
+    n = sendmmsg(sock, msg, cnt, MSG_DONTWAIT|MSG_NOSIGNAL);
+  }
+#elif !defined(WINDOWSVERSION)
+  for(n = 0; n < cnt; ++n)
+  {
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = to;
+    msg.msg_namelen = to ? tolen : 0;
+    msg.msg_iov = iov[n];
+    msg.msg_iovlen = iovcnt[n];
+    if(sendmsg(sock, &msg, MSG_DONTWAIT|MSG_NOSIGNAL) < 0)
+    {
+      if(!n) n = -1;
+      break;
+    }
+  }
+#else /* WINDOWSVERSION */
+  /* no gathering datagram send here, so the payload is copied */
+  for(n = 0; n < cnt; ++n)
+  {
+    char buf[RTCM3_MAXLEN+12]; /* an aligned packet may exceed BUFSZ */
+    int  l = 0, j;
+
+    for(j = 0; j < iovcnt[n]; ++j)
+    {
+      memcpy(buf+l, iov[n][j].iov_base, iov[n][j].iov_len);
+      l += iov[n][j].iov_len;
+    }
+    if((to ? sendto(sock, buf, l, 0, to, tolen) : send(sock, buf, l, 0)) < 0)
+    {
+      if(!n)
+      {
+        errno = WSAGetLastError() == WSAEWOULDBLOCK ? EAGAIN : EIO;
+        n = -1;
+      }
+      break;
+    }
+  }
+#endif /* WINDOWSVERSION */
+  if(n < 0)
+  {
+    if(errno == EAGAIN || errno == EWOULDBLOCK)
+      ++metrics.eagain;
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+  }
+  metrics.writes += n;
+  if(n < cnt)
+    ++metrics.short_writes;
+  for(i = 0; i < n; ++i)
+    ring_consume(q, len[i]);
+  *seq += n;
+  return n;
+} /* send_rtp */
+#ifndef WINDOWSVERSION
+
+
+/********************************************************************
+ * input thread                                                     *
+ *                                                                  *
+ * With "-T thread" the input is read by its own thread straight    *
+ * into a single producer/single consumer ring and the main thread  *
+ * only sends to the caster. The ring needs no locks, the output    *
+ * thread sleeps on a pipe only while the ring is empty. A full     *
+ * ring drops input instead of blocking the reads, only file input  *
+ * waits for free space as it can't overrun.                        *
+*********************************************************************/
+static int input_fd(void)
+{
+  if(inputmode == INFILE) return gps_file;
+  if(inputmode == SERIAL) return gps_serial;
+  return gps_socket;
+} /* input_fd */
+
+static void queue_wakeup(struct inputqueue *q, int force)
+{
+  RING_FENCE();
+  if(q->sleeping || force)
+  {
+    q->sleeping = 0;
+    if(write(q->wakeup[1], "", 1) < 0 && errno != EAGAIN)
+      perror("WARNING: waking up output thread");
+  }
+} /* queue_wakeup */
+
+/* blocking read with cancellation enabled only while waiting */
+static int input_read(int fd, struct iovec *iov, int cnt)
+{
+  int n;
+
+  pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
+  n = readv(fd, iov, cnt);
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+  return n;
+} /* input_read */
+
+static void *input_thread(void *arg)
+{
+  struct inputqueue *q = arg;
+  char               buffer[BUFSZ], sisnetbackbuffer[200];
+  struct iovec       iov[2];
+  int                fd = input_fd(), cnt, n;
+  sigset_t           set;
+
+  /* signals are handled by the output thread */
+  sigfillset(&set);
+  pthread_sigmask(SIG_BLOCK, &set, 0);
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+  memset(buffer, 0, sizeof(buffer));
+  for(;;)
+  {
+    if(inputmode == SISNET && sisnet <= 30)
+    {
+      /* see transfer_data() */
+      struct timeval tv = {0,700000};
+      int i = (sisnet >= 30 ? 5 : 3);
+      pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
+      select(0, 0, 0, 0, &tv);
+      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+      memcpy(sisnetbackbuffer, buffer, sizeof(sisnetbackbuffer));
+      if((send(fd, "MSG\r\n", i, 0)) != i)
+      {
+        perror("WARNING: sending SISNeT data request failed");
+        break;
+      }
+      cnt = 0;
+    }
+    else if(inputmode == INFILE && ring_used(&q->ring) + BUFSZ > q->ring.size)
+    {
+      /* wait until queue_consumed() reports free space */
+      struct pollfd pfd;
+      char          drain[16];
+      q->full = 1;
+      RING_FENCE();
+      if(ring_used(&q->ring) + BUFSZ > q->ring.size)
+      {
+        pfd.fd = q->space[0];
+        pfd.events = POLLIN;
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
+        poll(&pfd, 1, 1000);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+      }
+      q->full = 0;
+      while(read(q->space[0], drain, sizeof(drain)) > 0)
+        ;
+      continue;
+    }
+    else if((cnt = ring_space(&q->ring, iov)) && iov[0].iov_len
+    + (cnt > 1 ? iov[1].iov_len : 0) < BUFSZ)
+      cnt = 0; /* nearly full, don't cut datagrams */
+    if(!cnt)
+    {
+      iov[0].iov_base = buffer;
+      iov[0].iov_len = sizeof(buffer);
+    }
+    if(replay.active)
+    {
+      long long now = msec();
+
+      if((n = replay_read(&replay, iov, cnt ? cnt : 1, now)) < 0
+      && errno == EAGAIN)
+      {
+        /* sleep until the next bytes are due */
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
+        poll(0, 0, (int)((long long)replay.due + 1 - now));
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+        continue;
+      }
+      if(!n)
+        break; /* the end of the replay ends the input */
+    }
+    else if(!(n = input_read(fd, iov, cnt ? cnt : 1)))
+    {
+      fprintf(stderr, "WARNING: no data received from input\n");
+      pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
+      sleep(3);
+      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+      continue;
+    }
+    else if(n < 0)
+    {
+      if(errno == EINTR) continue;
+      perror("WARNING: reading input failed");
+      break;
+    }
+    if(!cnt)
+    {
+      if(inputmode == SISNET && sisnet <= 30 &&
+      !memcmp(sisnetbackbuffer, buffer, sizeof(sisnetbackbuffer)))
+        continue;
+      /* copy what fits into the ring, drop the rest */
+      int c = ring_copy(&q->ring, buffer, n);
+      q->dropped += n - c;
+      rtcm_input(&q->ring, &q->framer, (size_t)c);
+    }
+    else
+      rtcm_input(&q->ring, &q->framer, (size_t)n);
+    if(ring_used(&q->ring) > q->maxused)
+      q->maxused = ring_used(&q->ring);
+    queue_wakeup(q, 0);
+  }
+  q->done = 1;
+  queue_wakeup(q, 1);
+  return 0;
+} /* input_thread */
+
+static struct inputqueue *queue_start(size_t size)
+{
+  struct inputqueue *q;
+
+  if(!(q = calloc(1, sizeof(*q))) || !ring_init(&q->ring, size))
+  {
+    fprintf(stderr, "ERROR: can't allocate input queue\n");
+    free(q);
+    return 0;
+  }
+  if(pipe(q->wakeup) < 0)
+  {
+    perror("ERROR: input queue pipe");
+    ring_free(&q->ring);
+    free(q);
+    return 0;
+  }
+  if(pipe(q->space) < 0)
+  {
+    perror("ERROR: input queue pipe");
+    close(q->wakeup[0]);
+    close(q->wakeup[1]);
+    ring_free(&q->ring);
+    free(q);
+    return 0;
+  }
+  rtcm_init(&q->framer, rtcmmode);
+  q->ring.framed = rtcmmode == RTCM_ALIGN;
+  q->ring.expire = maxage != 0;
+  lat_attach(&q->ring, &latency);
+  fcntl(q->wakeup[0], F_SETFL, O_NONBLOCK);
+  fcntl(q->wakeup[1], F_SETFL, O_NONBLOCK);
+  fcntl(q->space[0], F_SETFL, O_NONBLOCK);
+  fcntl(q->space[1], F_SETFL, O_NONBLOCK);
+  if(pthread_create(&q->thread, 0, input_thread, q))
+  {
+    fprintf(stderr, "ERROR: can't start input thread\n");
+    close(q->wakeup[0]);
+    close(q->wakeup[1]);
+    close(q->space[0]);
+    close(q->space[1]);
+    ring_free(&q->ring);
+    free(q);
+    return 0;
+  }
+  fprintf(stderr, "input thread started, queue size %lu bytes\n",
+  (unsigned long)q->ring.size);
+  return q;
+} /* queue_start */
+
+static void queue_stop(struct inputqueue *q)
+{
+  pthread_cancel(q->thread);
+  pthread_join(q->thread, 0);
+  close(q->wakeup[0]);
+  close(q->wakeup[1]);
+  close(q->space[0]);
+  close(q->space[1]);
+  ring_free(&q->ring);
+  free(q);
+} /* queue_stop */
+
+/* the output thread has consumed data, wake a waiting input thread */
+static void queue_consumed(struct inputqueue *q)
+{
+  RING_FENCE();
+  if(q->full)
+  {
+    q->full = 0;
+    if(write(q->space[1], "", 1) < 0 && errno != EAGAIN)
+      perror("WARNING: waking up input thread");
+  }
+} /* queue_consumed */
+
+/* prepares the output thread to wait for queued input, returns 1 if it
+   needs to wait for the wakeup pipe */
+static int queue_sleep(struct inputqueue *q)
+{
+  if(ring_used(&q->ring))
+    return 0;
+  q->sleeping = 1;
+  RING_FENCE();
+  if(ring_used(&q->ring) || q->done)
+  {
+    q->sleeping = 0;
+    return 0;
+  }
+  return 1;
+} /* queue_sleep */
+
+/* the output thread is awake again */
+static void queue_awake(struct inputqueue *q)
+{
+  char drain[16];
+
+  q->sleeping = 0;
+  while(read(q->wakeup[0], drain, sizeof(drain)) > 0)
+    ;
+} /* queue_awake */
+
+static void queue_status(const struct inputqueue *q)
+{
+  fprintf(stderr, "input queue: %lu of %lu bytes used, maximum %lu, "
+  "%lu bytes dropped\n", (unsigned long)ring_used(&q->ring),
+  (unsigned long)q->ring.size, (unsigned long)q->maxused, q->dropped);
+  rtcm_status(&q->framer);
+  lat_status(q->ring.lat, 0);
+} /* queue_status */
+#endif /* WINDOWSVERSION */
+
+
+/********************************************************************
+ * input backlog                                                    *
+ *                                                                  *
+ * The input stays open while the caster is reconnected, only a     *
+ * failed input is opened again with its whole handshake. In the    *
+ * reconnect delay the input is read on into the queue, with -T     *
+ * thread the input thread simply goes on, and the next transfer    *
+ * starts with what arrived meanwhile. Bytes older than -K seconds  *
+ * are dropped first, their age is taken from the latency marks,    *
+ * and a full queue drops its oldest bytes for new input. With -r   *
+ * the queue only holds whole frames, so the cuts fall between      *
+ * frames, and a frame the last caster got only in part is skipped. *
+ * File input is not read ahead, it waits in the file.              *
+*********************************************************************/
+/* the queue the input is read into, allocated with the first use */
+static struct ringbuf *backlog_queue(void)
+{
+#ifndef WINDOWSVERSION
+  if(transfer == THREAD)
+  {
+    if(!backlog.queue)
+      backlog.queue = queue_start(queuesize);
+    return backlog.queue ? &backlog.queue->ring : 0;
+  }
+#endif
+  if(!backlog.ring.data)
+  {
+    if(!ring_init(&backlog.ring, queuesize))
+    {
+      fprintf(stderr, "ERROR: can't allocate output queue\n");
+      return 0;
+    }
+    backlog.ring.framed = rtcmmode == RTCM_ALIGN;
+    backlog.ring.expire = maxage != 0;
+    lat_attach(&backlog.ring, &latency);
+    rtcm_init(&backlog.framer, rtcmmode);
+  }
+  return &backlog.ring;
+} /* backlog_queue */
+
+/* drop the n oldest queued bytes, only for the consumer */
+static void backlog_drop(struct ringbuf *r, size_t n)
+{
+  if(!n)
+    return;
+  ring_skip(r, n);
+  metrics.backlog_dropped += n;
+} /* backlog_drop */
+
+/* bytes before the first whole frame, the frames from there lead exactly
+   to the head */
+static size_t backlog_sync(const struct ringbuf *r)
+{
+  size_t head = RING_LOAD(&r->head), skip, pos;
+
+  for(skip = 0; r->tail + skip != head; ++skip)
+  {
+    for(pos = r->tail + skip; (long)(head - pos) >= 3
+    && RING_BYTE(r, pos) == RTCM3_PREAMBLE && !(RING_BYTE(r, pos+1) & 0xFC);
+    pos += (((RING_BYTE(r, pos+1) & 3) << 8) | RING_BYTE(r, pos+2)) + 6)
+      ;
+    if(pos == head)
+      break;
+  }
+  return skip;
+} /* backlog_sync */
+
+/* drop what is older than -K seconds and what is left of a frame the last
+   caster got in part */
+static void backlog_trim(struct ringbuf *r)
+{
+  struct latency *l = r->lat;
+  long long       old = usec() - backlogage*1000000LL;
+  size_t          n = 0, t, h;
+
+  if(rtcmmode != RTCM_NONE)
+    n = backlog_sync(r);
+  /* file input doesn't age, it only waited in the file */
+  if(l && inputmode != INFILE)
+  {
+    for(t = l->marktail, h = RING_LOAD(&l->markhead); t != h
+    && l->mark[t % LATMARKS].usec <= old; ++t)
+    {
+      if((long)(l->mark[t % LATMARKS].end - r->tail) > (long)n)
+        n = l->mark[t % LATMARKS].end - r->tail;
+    }
+  }
+  backlog_drop(r, n);
+} /* backlog_trim */
+
+/* Drop what was read before old (msec()) and is still queued while the
+   caster lags, returns the number of bytes. The reads of RTCM 3 input end
+   between frames, a frame the caster got in part is finished first. */
+static size_t backlog_expire(struct ringbuf *r, long long old)
+{
+  struct latency *l = r->lat;
+  size_t          n = 0, t, h;
+
+  if(!l)
+    return 0;
+  for(t = l->marktail, h = RING_LOAD(&l->markhead); t != h
+  && l->mark[t % LATMARKS].usec <= old*1000; ++t)
+    n = l->mark[t % LATMARKS].end - r->tail;
+  if(!n)
+    return 0;
+  if(r->expire && r->frame != r->tail)
+  {
+    r->finish = 1;
+    return 0;
+  }
+  ring_skip(r, n);
+  metrics.expired += n;
+  return n;
+} /* backlog_expire */
+
+#ifndef WINDOWSVERSION
+/* room for the next read, a full queue drops its oldest bytes */
+static void backlog_room(struct ringbuf *r)
+{
+  size_t used = ring_used(r), n;
+
+  if(ring_room(r) >= BUFSZ)
+    return;
+  if(rtcmmode == RTCM_NONE)
+    n = BUFSZ - ring_room(r);
+  else
+  {
+    for(n = backlog_sync(r); n < used && ring_room(r) + n < BUFSZ; )
+      n += (((RING_BYTE(r, r->tail+n+1) & 3) << 8)
+      | RING_BYTE(r, r->tail+n+2)) + 6;
+  }
+  backlog_drop(r, n < used ? n : used);
+} /* backlog_room */
+
+/* the reconnect delay, meanwhile the input is read on into the queue */
+static void backlog_wait(int sec)
+{
+  struct ringbuf *r = transfer == SPLICE ? 0 : backlog_queue();
+  long long       now = msec(), end = now + sec*1000LL, retry = now;
+  struct pollfd   p;
+  struct iovec    iov[2];
+  int             n, reading;
+
+  while(backlog.open && !sigint_received && now < end)
+  {
+    /* splice has no queue, there the input waits in the kernel like
+       files do, SISNeT blocks only come on request */
+    reading = r && !backlog.queue && inputmode != INFILE
+    && !(inputmode == SISNET && sisnet <= 30) && now >= retry;
+    p.fd = input_fd();
+    p.events = POLLIN;
+    p.revents = 0;
+    /* the queue is trimmed every 100 ms */
+    n = poll(&p, reading ? 1 : 0, (int)(end - now < 100 ? end - now : 100));
+    if(n > 0 && p.revents)
+    {
+      backlog_room(r);
+      n = readv(p.fd, iov, ring_space(r, iov));
+      if(!n && inputmode == SERIAL)
+        retry = now + 3000;
+      else if(!n && inputmode != UDPSOCKET)
+      {
+        fprintf(stderr, "WARNING: no data received from input\n");
+        backlog.open = 0;
+      }
+      else if(n < 0 && errno != EAGAIN && errno != EINTR)
+      {
+        perror("WARNING: reading input failed");
+        backlog.open = 0;
+      }
+      else if(n > 0)
+        rtcm_input(r, &backlog.framer, (size_t)n);
+    }
+    else if(backlog.queue && backlog.queue->done)
+    {
+      fprintf(stderr, "WARNING: input thread has ended\n");
+      backlog.open = 0;
+    }
+    if(r)
+    {
+      backlog_trim(r);
+      if(backlog.queue)
+        queue_consumed(backlog.queue);
+      metrics.queued = ring_used(r);
+    }
+    now = msec();
+  }
+  if(!backlog.open)
+    close_input();
+} /* backlog_wait */
+#endif /* WINDOWSVERSION */
+
+
+/********************************************************************
+ * timed replay                                                     *
+ *                                                                  *
+ * With -t the file input goes out at the pace it was recorded with *
+ * instead of as fast as the caster takes it. A capture file, which *
+ * starts with CAPMAGIC, holds records of a 4 byte arrival time in  *
+ * milliseconds and a 2 byte length (both big endian) before their  *
+ * data, like fakecaster -c writes them; each record is due at its  *
+ * time. Any other file is taken as RTCM 3, there each observation  *
+ * message is due at its epoch time, the other bytes go out with    *
+ * what came before them. The times are divided by the speed, 0 is  *
+ * as fast as possible. With loop the file starts over one interval *
+ * after its end. The file is read ahead into a ring of its own,    *
+ * what is due is handed out by replay_read().                      *
+*********************************************************************/
+/* -t <Speed>[,loop], returns 0 if it is invalid */
+static int replay_parse(const char *spec)
+{
+  char *end;
+
+  if(!strncmp(spec, "max", 3))
+  {
+    replay.speed = 0;
+    end = (char *)spec + 3;
+  }
+  else if((replay.speed = strtod(spec, &end)) <= 0)
+    return 0;
+  if(!strcmp(end, ",loop"))
+    replay.loop = 1;
+  else if(*end)
+    return 0;
+  replay.active = 1;
+  return 1;
+} /* replay_parse */
+
+/* the file was opened, it starts from the beginning */
+static int replay_open(struct replay *p)
+{
+  if(!p->ring.data && !ring_init(&p->ring, REPLAYSZ))
+  {
+    fprintf(stderr, "ERROR: can't allocate replay buffer\n");
+    return 0;
+  }
+  rtcm_crcinit();
+  p->ring.head = p->ring.tail = 0;
+  p->ready = 0;
+  p->eof = 0;
+  p->start = 1;
+  p->last = -1;
+  p->interval = 0;
+  p->due = (double)msec();
+  return 1;
+} /* replay_open */
+
+/* the transfer starts again after a reconnect, the file waited meanwhile */
+static void replay_resume(struct replay *p)
+{
+  if(p->due < (double)msec())
+    p->due = (double)msec();
+} /* replay_resume */
+
+/* read more of the file into the ring, returns 0 at its end or on error */
+static int replay_fill(struct replay *p)
+{
+  struct iovec iov[2];
+  int          n;
+
+  if(p->eof || !ring_space(&p->ring, iov))
+    return 0;
+  if((n = read(gps_file, iov[0].iov_base, iov[0].iov_len)) > 0)
+  {
+    ring_produce(&p->ring, (size_t)n);
+    return 1;
+  }
+  p->eof = n < 0 ? -1 : 1;
+  return 0;
+} /* replay_fill */
+
+/* whether the record or epoch of time t (ms) is due at now, the first
+   time it is seen it is scheduled after the last one */
+static int replay_timed(struct replay *p, long long t, long long now)
+{
+  long long d;
+
+  if(t != p->last)
+  {
+    if(p->last < 0)
+      d = p->interval;  /* the file starts (over) */
+    else if(p->capture)
+      d = t > p->last ? t - p->last : 0;
+    else
+    {
+      /* the epochs wrap with the GPS week or day, a jump isn't waited for */
+      d = ((t - p->last) % 86400000LL + 86400000LL) % 86400000LL;
+      if(d > 3600000LL)
+        d = 0;
+    }
+    if(d && p->last >= 0)
+      p->interval = d;
+    if(p->speed > 0)
+      p->due += d / p->speed;
+    p->last = t;
+  }
+  return now >= p->due;
+} /* replay_timed */
+
+/* decide on the bytes behind the ready ones, returns 1 when some are
+   ready, 0 when the next ones aren't due yet and -1 at the end */
+static int replay_next(struct replay *p, long long now)
+{
+  struct ringbuf *r = &p->ring;
+  size_t          used, pos, len;
+
+  for(;;)
+  {
+    used = ring_used(r) - p->ready;
+    pos = r->tail + p->ready;
+    if(p->start)
+    {
+      if(used < sizeof(CAPMAGIC)-1 && replay_fill(p))
+        continue;
+      for(len = 0; len < sizeof(CAPMAGIC)-1 && len < used
+      && RING_BYTE(r, r->tail+len) == (unsigned char)CAPMAGIC[len]; ++len)
+        ;
+      if((p->capture = len == sizeof(CAPMAGIC)-1))
+        ring_skip(r, len);
+      p->start = 0;
+      continue;
+    }
+    if(p->capture)
+    {
+      /* the header is taken when the record before is handed out */
+      if(p->ready)
+        return 1;
+      len = used < 6 ? 6 : ((RING_BYTE(r, pos+4) << 8)
+      | RING_BYTE(r, pos+5)) + 6;
+      if(used >= len)
+      {
+        if(!replay_timed(p, ((long long)RING_BYTE(r, pos) << 24)
+        | (RING_BYTE(r, pos+1) << 16) | (RING_BYTE(r, pos+2) << 8)
+        | RING_BYTE(r, pos+3), now))
+          return 0;
+        ring_skip(r, 6);
+        p->ready = len-6;
+        continue;
+      }
+    }
+    else if(used >= 3 && RING_BYTE(r, pos) == RTCM3_PREAMBLE
+    && !(RING_BYTE(r, pos+1) & 0xFC))
+    {
+      len = (((RING_BYTE(r, pos+1) & 3) << 8) | RING_BYTE(r, pos+2)) + 6;
+      if(used >= len)
+      {
+        long long t = -1;
+
+        if(len >= 6+2 && rtcm_crc(r, pos, len-3)
+        == (((unsigned long)RING_BYTE(r, pos+len-3) << 16)
+        | (RING_BYTE(r, pos+len-2) << 8) | RING_BYTE(r, pos+len-1)))
+          t = rtcm_epoch(r, pos+3, rtcm_bits(r, pos+3, 0, 12), len-6);
+        if(t >= 0 && !replay_timed(p, t, now))
+          return p->ready ? 1 : 0;
+        p->ready += len;
+        if(p->ready >= BUFSZ)
+          return 1;
+        continue;
+      }
+    }
+    else if(used)
+    {
+      /* no frame, up to the next preamble */
+      for(len = 1; len < used && RING_BYTE(r, pos+len) != RTCM3_PREAMBLE;
+      ++len)
+        ;
+      p->ready += len;
+      continue;
+    }
+    /* incomplete, more of the file is needed */
+    if(replay_fill(p))
+      continue;
+    if(!p->eof)
+      return p->ready ? 1 : 0; /* the ring is full */
+    if(p->eof < 0)
+      return -1;
+    if(p->capture)
+      ring_skip(r, used); /* a cut off record */
+    else
+      p->ready += used;
+    if(p->ready)
+      return 1;
+    if(!p->loop || lseek(gps_file, 0, SEEK_SET) != 0)
+      return -1;
+    r->head = r->tail = 0;
+    p->eof = 0;
+    p->start = 1;
+    p->last = -1;
+  }
+} /* replay_next */
+
+/* Hand out what is due of the file into cnt iovecs. Returns the number
+   of bytes, 0 at the end of the file and -1 on a read error, or with
+   errno EAGAIN when nothing is due before p->due. */
+static int replay_read(struct replay *p, struct iovec *iov, int cnt,
+long long now)
+{
+  struct iovec src[2];
+  int          i, j, k, n = 0;
+
+  if((i = replay_next(p, now)) < 0)
+    return p->eof < 0 ? -1 : 0;
+  if(!i)
+  {
+    errno = EAGAIN;
+    return -1;
+  }
+  k = ring_data(&p->ring, 0, src, p->ready);
+  for(i = j = 0; i < cnt && j < k; )
+  {
+    size_t c = iov[i].iov_len < src[j].iov_len ? iov[i].iov_len
+    : src[j].iov_len;
+
+    memcpy(iov[i].iov_base, src[j].iov_base, c);
+    n += (int)c;
+    src[j].iov_base = (char *)src[j].iov_base + c;
+    src[j].iov_len -= c;
+    iov[i].iov_base = (char *)iov[i].iov_base + c;
+    iov[i].iov_len -= c;
+    if(!iov[i].iov_len) ++i;
+    if(!src[j].iov_len) ++j;
+  }
+  ring_skip(&p->ring, (size_t)n);
+  p->ready -= n;
+  return n;
+} /* replay_read */
+
+
+#ifndef WINDOWSVERSION
+/********************************************************************
+ * hot standby                                                      *
+ *                                                                  *
+ * With -G a thread of its own keeps a second upload connection to  *
+ * the standby caster open, which is accepted but gets no data.     *
+ * When the transfer to the caster fails for any reason but the     *
+ * input, the standby connection takes over with the queue as it    *
+ * is, so nothing waits for the reconnect delay, DNS, connect and   *
+ * the handshake. The thread then connects the caster which failed, *
+ * as the new standby, so the upload can switch back again. Only    *
+ * the Ntrip 1.0 and the HTTP upload are TCP streams which can be   *
+ * taken over like that.                                            *
+*********************************************************************/
+/* -G <Host>[:<Port>][/<Mountpoint>], returns 0 if it is invalid */
+static int standby_parse(const char *spec, unsigned int port)
+{
+  struct standbytarget *t = &standby.target[1];
+  char                 *p;
+
+  if(strlen(spec) >= sizeof(standby.spec))
+    return 0;
+  strcpy(standby.spec, spec);
+  t->host = t->caster = standby.spec;
+  t->port = port;
+  t->mountpoint = mountpoint;
+  t->extension = "";
+  if((p = strchr(standby.spec, '/')))
+  {
+    *p++ = 0;
+    if(*p)
+      t->mountpoint = p;
+  }
+  if((p = strchr(standby.spec, ':')))
+  {
+    *p++ = 0;
+    if(!(t->port = atoi(p)) || t->port > 65535)
+      return 0;
+  }
+  if(!*standby.spec)
+    return 0;
+  standby.sock = standby.pending = INVALID_SOCKET;
+  pthread_mutex_init(&standby.lock, 0);
+  t->resolve = &standby.resolve;
+  resolve_init(t->resolve, t->host, t->port);
+  return 1;
+} /* standby_parse */
+
+/* connect and send the upload request like main() does, returns the
+   accepted connection */
+static sockettype standby_connect(const struct standbytarget *t)
+{
+  struct hostaddrs addrs;
+  struct timeval   tv = {CONNECTTIME, 0};
+  char             buf[BUFSZ];
+  sockettype       s;
+  int              n;
+
+  /* the lookup runs in a thread of its own, see resolve_start() */
+  while((n = resolve_get(t->resolve, &addrs, 0)) < 0)
+  {
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
+    poll(0, 0, 100);
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+  }
+  if(!n)
+    return INVALID_SOCKET;
+  pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
+  s = resolve_connect(&addrs, SOCK_STREAM, "standby", fastopen, &n);
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+  if(s == INVALID_SOCKET)
+  {
+    fprintf(stderr, "WARNING: can't connect standby caster %s at port %u\n",
+    t->host, t->port);
+    return INVALID_SOCKET;
+  }
+  standby.pending = s;
+  caster_sockopts(s, deadtime, nagle, maxage);
+  setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  n = build_caster_request(buf, sizeof(buf), standby.outmode, t->extension,
+  t->mountpoint, t->caster, standby.authorization, standby.password,
+  standby.ntrip_str);
+  if(n <= 0 || n >= (int)sizeof(buf))
+    n = 0;
+  else
+  {
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
+    if(send(s, buf, (size_t)n, MSG_NOSIGNAL) != n)
+      n = 0;
+    else
+      n = recv(s, buf, sizeof(buf)-1, 0);
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+  }
+  buf[n > 0 ? n : 0] = 0;
+  if(n <= 0 || !strstr(buf, standby.outmode == NTRIP1 ? "OK"
+  : "HTTP/1.1 200 OK"))
+  {
+    char *c;
+    fprintf(stderr, "WARNING: standby caster %s didn't accept the upload: ",
+    t->host);
+    for(c = buf; *c && *c != '\n' && *c != '\r'; ++c)
+      fprintf(stderr, "%.1s", isprint(*c) ? c : ".");
+    fprintf(stderr, "\n");
+    closesocket(s);
+    standby.pending = INVALID_SOCKET;
+    return INVALID_SOCKET;
+  }
+  /* the transfer sends with MSG_DONTWAIT */
+  tv.tv_sec = 0;
+  setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  standby.pending = INVALID_SOCKET;
+  return s;
+} /* standby_connect */
+
+static void *standby_thread(void *arg)
+{
+  struct standby       *sb = arg;
+  struct standbytarget *t;
+  struct pollfd         p;
+  sigset_t              set;
+  sockettype            s;
+  char                  buf[256];
+  int                   retry = 0, n;
+
+  /* signals are handled by the main thread */
+  sigfillset(&set);
+  pthread_sigmask(SIG_BLOCK, &set, 0);
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+  for(;;)
+  {
+    pthread_mutex_lock(&sb->lock);
+    t = &sb->target[!sb->active];
+    s = sb->ready ? sb->sock : INVALID_SOCKET;
+    pthread_mutex_unlock(&sb->lock);
+    if(s == INVALID_SOCKET)
+    {
+      /* a failed caster is tried again after a growing pause */
+      pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
+      sleep(retry);
+      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+      if((s = standby_connect(t)) == INVALID_SOCKET)
+      {
+        retry = retry ? (retry < 32 ? 2*retry : 64) : 1;
+        continue;
+      }
+      retry = 0;
+      pthread_mutex_lock(&sb->lock);
+      sb->sock = s;
+      sb->ready = 1;
+      pthread_mutex_unlock(&sb->lock);
+      fprintf(stderr, "standby connection to %s at port %u ready\n",
+      t->host, t->port);
+      continue;
+    }
+    /* the idle upload ends only when the caster closes it, and the
+       main thread may take it meanwhile */
+    p.fd = s;
+    p.events = POLLIN;
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
+    n = poll(&p, 1, 200);
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+    if(n <= 0)
+      continue;
+    pthread_mutex_lock(&sb->lock);
+    if(sb->ready && sb->sock == s
+    && ((n = recv(s, buf, sizeof(buf), MSG_DONTWAIT)) == 0
+    || (n < 0 && errno != EAGAIN && errno != EINTR)))
+    {
+      fprintf(stderr, "WARNING: standby caster %s closed the connection\n",
+      t->host);
+      closesocket(s);
+      sb->sock = INVALID_SOCKET;
+      sb->ready = 0;
+    }
+    pthread_mutex_unlock(&sb->lock);
+  }
+  return 0;
+} /* standby_thread */
+
+/* keeps the other caster ready while a transfer runs */
+static void standby_start(int outmode)
+{
+  if(!standby.target[1].host || standby.running)
+    return;
+  standby.outmode = outmode;
+  standby.active = 0;
+  standby.ready = 0;
+  if(pthread_create(&standby.thread, 0, standby_thread, &standby))
+  {
+    fprintf(stderr, "WARNING: can't start standby thread\n");
+    return;
+  }
+  standby.running = 1;
+} /* standby_start */
+
+/* the standby connection becomes the output, returns 0 without one */
+static int standby_takeover(void)
+{
+  struct standbytarget *t;
+  int                   ok;
+
+  if(!standby.running)
+    return 0;
+  pthread_mutex_lock(&standby.lock);
+  if((ok = standby.ready))
+  {
+    closesocket(socket_tcp);
+    socket_tcp = standby.sock;
+    standby.sock = INVALID_SOCKET;
+    standby.ready = 0;
+    standby.active = !standby.active;
+  }
+  t = &standby.target[standby.active];
+  pthread_mutex_unlock(&standby.lock);
+  if(!ok)
+    return 0;
+  ++metrics.failovers;
+  sigpipe_received = sigalarm_received = 0;
+  fprintf(stderr, "switching over to %s at port %u\n", t->host, t->port);
+  return 1;
+} /* standby_takeover */
+
+/* back to the primary caster with the full reconnect */
+static void standby_stop(void)
+{
+  if(!standby.running)
+    return;
+  pthread_cancel(standby.thread);
+  pthread_join(standby.thread, 0);
+  if(standby.ready)
+    closesocket(standby.sock);
+  if(standby.pending != INVALID_SOCKET)
+    closesocket(standby.pending);
+  standby.sock = standby.pending = INVALID_SOCKET;
+  standby.ready = 0;
+  standby.running = 0;
+} /* standby_stop */
+#endif /* WINDOWSVERSION */
+
+
+#ifdef HAVE_SPLICE
+/********************************************************************
+ * splice forwarding                                                *
+ *                                                                  *
+ * With "-T splice" Ntrip-Version 1.0 output moves the input to the *
+ * caster through a pipe with splice(), the data never enters user  *
+ * space. The pipe takes the role of the input queue, both ends are *
+ * driven without blocking from one poll(). Returns 1 without       *
+ * having consumed any input if the input can't be spliced.         *
+*********************************************************************/
+static int transfer_splice(sockettype sock)
+{
+  int    pfd[2], full = 0, inputend = 0, moved = 0, sent = 0;
+  size_t pending = 0, pipesize;
+  long   n;
+
+  if(pipe(pfd) < 0)
+  {
+    perror("WARNING: can't create splice pipe");
+    return 1;
+  }
+  /* ask for a pipe of the queue size, the kernel may round or limit it */
+  fcntl(pfd[1], F_SETPIPE_SZ, (int)queuesize);
+  if((n = fcntl(pfd[1], F_GETPIPE_SZ)) > 0)
+    pipesize = (size_t)n;
+  else
+    pipesize = 65536;
+  metrics.queuesize = pipesize;
+  if(fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) < 0)
+  {
+    fprintf(stderr, "Could not set nonblocking mode\n");
+    close(pfd[0]);
+    close(pfd[1]);
+    return 0;
+  }
+
+  fprintf(stderr,"transfering data ...\n");
+  alarm(ALARMTIME);
+  while(!sigalarm_received && !sigint_received && !sigpipe_received)
+  {
+    struct pollfd p[2];
+
+    if(sigusr1_received)
+    {
+      sigusr1_received = 0;
+      fprintf(stderr, "splice pipe: %lu of %lu bytes used\n",
+      (unsigned long)pending, (unsigned long)pipesize);
+      tcp_sample(sock, msec(), 1);
+    }
+    tcp_sample(sock, msec(), 0);
+    /* a pipe buffer holds one page at most, so small reads may fill the
+       pipe before pending reaches its size; full stops reading then */
+    p[0].fd = input_fd();
+    p[0].events = (!inputend && !full && pending < pipesize) ? POLLIN : 0;
+    p[1].fd = sock;
+    p[1].events = pending ? POLLOUT : 0;
+    metrics.queued = pending;
+    if(poll(p, 2, 1000) < 0)
+    {
+      if(errno == EINTR)
+        continue;
+      perror("WARNING: waiting for data failed");
+      break;
+    }
+    if(p[1].revents & (POLLERR|POLLHUP))
+    {
+      fprintf(stderr, "WARNING: connection to Destination caster closed\n");
+      break;
+    }
+    if(p[0].events && p[0].revents)
+    {
+      /*** receiving data ****/
+      n = splice(p[0].fd, 0, pfd[1], 0, pipesize - pending,
+      SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+      if(n < 0 && errno == EINVAL && !moved)
+      {
+        close(pfd[0]);
+        close(pfd[1]);
+        return 1;
+      }
+      else if(n < 0 && errno == EAGAIN)
+        full = 1;
+      else if(n < 0 && errno != EINTR)
+      {
+        if(!sigint_received)
+          perror("WARNING: reading input failed");
+        backlog.open = 0;
+        break;
+      }
+      else if(!n)
+      {
+        fprintf(stderr, "WARNING: no data received from input\n");
+        /* don't delay data which is still waiting for the caster */
+        if(pending)
+          inputend = 1;
+        else
+          sleep(3);
+      }
+      else if(n > 0)
+      {
+        pending += n;
+        moved = 1;
+        metrics.bytes_in += n;
+        metrics.lastinput = msec();
+        alarm(ALARMTIME);
+      }
+    }
+    /**  send data ***/
+    if(pending && (p[1].revents & POLLOUT))
+    {
+      n = splice(pfd[0], 0, sock, 0, pending, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+      if(n < 0 && errno != EAGAIN && errno != EINTR)
+      {
+        perror("WARNING: could not send data to Destination caster");
+        break;
+      }
+      else if(n < 0 && errno == EAGAIN)
+        ++metrics.eagain;
+      else if(n > 0)
+      {
+        ++metrics.writes;
+        if((size_t)n < pending)
+          ++metrics.short_writes;
+        metrics.bytes_out += n;
+        metrics_sent(msec());
+        pending -= n;
+        full = 0;
+        if(!pending)
+          inputend = 0;
+        if(!sent++)
+          reconnect_sec = 1;
+      }
+    }
+  }
+  /* no input for ALARMTIME seconds, though there was room to read */
+  if(sigalarm_received && !full && pending < pipesize)
+    backlog.open = 0;
+  close(pfd[0]);
+  close(pfd[1]);
+  return 0;
+} /* transfer_splice */
+#endif /* HAVE_SPLICE */
+
+
+#ifdef IO_URING
+/********************************************************************
+ * io_uring transfer                                                *
+ *                                                                  *
+ * With "-T uring" the read of the input into the ring and the send *
+ * of the queued data are both submitted to an io_uring, together   *
+ * with a one second timer, and one io_uring_enter() submits them   *
+ * and waits for the next completion. The ring is registered, so    *
+ * reads and plain NTRIP1 sends use fixed buffers. The read and the *
+ * send are not linked, as the length of a send is only known once  *
+ * the read completed; instead they run side by side on different   *
+ * parts of the ring.                                               *
+*********************************************************************/
+struct uring
+{
+  int                 fd;
+  unsigned           *sqhead, *sqtail, *sqmask, *sqarray;
+  unsigned           *cqhead, *cqtail, *cqmask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void               *sqmap, *cqmap;
+  size_t              sqmapsz, cqmapsz, sqessz;
+  unsigned            prepared;   /* filled in, the tail doesn't show them */
+  unsigned            tosubmit;   /* behind the tail, not taken yet */
+};
+
+enum URINGOP { UR_READ = 1, UR_SEND, UR_TIMER, UR_CANCEL };
+
+static int uring_init(struct uring *u, unsigned entries)
+{
+  struct io_uring_params p;
+
+  memset(&p, 0, sizeof(p));
+  memset(u, 0, sizeof(*u));
+  if((u->fd = syscall(__NR_io_uring_setup, entries, &p)) < 0)
+    return -1;
+  u->sqmapsz = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+  u->cqmapsz = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+  u->sqessz = p.sq_entries*sizeof(struct io_uring_sqe);
+  if(p.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    if(u->cqmapsz > u->sqmapsz)
+      u->sqmapsz = u->cqmapsz;
+    u->cqmapsz = 0;
+  }
+  u->sqmap = mmap(0, u->sqmapsz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+  u->fd, IORING_OFF_SQ_RING);
+  u->cqmap = u->cqmapsz ? mmap(0, u->cqmapsz, PROT_READ|PROT_WRITE,
+  MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_CQ_RING) : u->sqmap;
+  u->sqes = mmap(0, u->sqessz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+  u->fd, IORING_OFF_SQES);
+  if(u->sqmap == MAP_FAILED || u->cqmap == MAP_FAILED
+  || u->sqes == MAP_FAILED)
+  {
+    if(u->sqmap != MAP_FAILED) munmap(u->sqmap, u->sqmapsz);
+    if(u->cqmapsz && u->cqmap != MAP_FAILED) munmap(u->cqmap, u->cqmapsz);
+    if(u->sqes != MAP_FAILED) munmap(u->sqes, u->sqessz);
+    close(u->fd);
+    return -1;
+  }
+  u->sqhead = (unsigned *)((char *)u->sqmap + p.sq_off.head);
+  u->sqtail = (unsigned *)((char *)u->sqmap + p.sq_off.tail);
+  u->sqmask = (unsigned *)((char *)u->sqmap + p.sq_off.ring_mask);
+  u->sqarray = (unsigned *)((char *)u->sqmap + p.sq_off.array);
+  u->cqhead = (unsigned *)((char *)u->cqmap + p.cq_off.head);
+  u->cqtail = (unsigned *)((char *)u->cqmap + p.cq_off.tail);
+  u->cqmask = (unsigned *)((char *)u->cqmap + p.cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe *)((char *)u->cqmap + p.cq_off.cqes);
+  return 0;
+} /* uring_init */
+
+static void uring_free(struct uring *u)
+{
+  munmap(u->sqes, u->sqessz);
+  if(u->cqmapsz) munmap(u->cqmap, u->cqmapsz);
+  munmap(u->sqmap, u->sqmapsz);
+  close(u->fd);
+} /* uring_free */
+
+/* next free submission entry, at most 3 are used, so there is always one */
+static struct io_uring_sqe *uring_sqe(struct uring *u, enum URINGOP op)
+{
+  unsigned             i = (*u->sqtail + u->prepared) & *u->sqmask;
+  struct io_uring_sqe *sqe = u->sqes + i;
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->user_data = op;
+  u->sqarray[i] = i;
+  ++u->prepared;
+  return sqe;
+} /* uring_sqe */
+
+/* cancel the request of the given kind */
+static void uring_cancel(struct uring *u, enum URINGOP op)
+{
+  struct io_uring_sqe *sqe = uring_sqe(u, UR_CANCEL);
+
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->addr = op;
+} /* uring_cancel */
+
+/* submit the prepared entries and wait for at least one completion,
+   entries the kernel didn't take yet stay behind the tail and are only
+   counted again */
+static int uring_enter(struct uring *u)
+{
+  int n;
+
+  __atomic_store_n(u->sqtail, *u->sqtail + u->prepared, __ATOMIC_RELEASE);
+  u->tosubmit += u->prepared;
+  u->prepared = 0;
+  n = syscall(__NR_io_uring_enter, u->fd, u->tosubmit, 1,
+  IORING_ENTER_GETEVENTS, 0, 0);
+  if(n > 0)
+    u->tosubmit -= n;
+  return n;
+} /* uring_enter */
+
+/* Returns 1 without having consumed any input if io_uring can't be used
+   here, else 0 */
+static int transfer_uring(sockettype sock, int outmode, struct ringbuf *ring)
+{
+  struct uring             u;
+  struct chunkstate        chunk;
+  struct iovec             reg, riov[2] = {{0, 0}, {0, 0}}, siov[4];
+  struct msghdr            msg;
+  struct __kernel_timespec ts = {1, 0};
+  int fd = input_fd(), flags, fixed, reading = 0, sending = 0, timing = 0;
+  int inputend = 0, sent = 0, stop = 0, cnt;
+  size_t offered = 0;
+
+  if(uring_init(&u, 8) < 0)
+    return 1;
+  /* registered buffers count against RLIMIT_MEMLOCK, else use plain I/O */
+  reg.iov_base = ring->data;
+  reg.iov_len = ring->size;
+  fixed = !syscall(__NR_io_uring_register, u.fd, IORING_REGISTER_BUFFERS,
+  &reg, 1);
+  /* a non-blocking input would complete with EAGAIN instead of waiting */
+  flags = fcntl(fd, F_GETFL);
+  fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+  memset(&chunk, 0, sizeof(chunk));
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = siov;
+
+  fprintf(stderr,"transfering data ...\n");
+  alarm(ALARMTIME);
+  while(!stop && !sigalarm_received && !sigint_received && !sigpipe_received)
+  {
+    struct io_uring_sqe *sqe;
+    unsigned             head, tail;
+
+    if(sigusr1_received)
+    {
+      sigusr1_received = 0;
+      fprintf(stderr, "output queue: %lu of %lu bytes used\n",
+      (unsigned long)ring_used(ring), (unsigned long)ring->size);
+      rtcm_status(&backlog.framer);
+      lat_status(ring->lat, 0);
+      tcp_sample(sock, msec(), 1);
+    }
+    tcp_sample(sock, msec(), 0);
+    metrics.queued = ring_used(ring);
+    /*** receiving data ****/
+    if(!reading && !inputend && ring_room(ring) >= BUFSZ)
+    {
+      sqe = uring_sqe(&u, UR_READ);
+      sqe->fd = fd;
+      sqe->off = (__u64)-1; /* current file position */
+      /* free space which wraps is read with both parts, a datagram
+         must not be cut at the end of the ring */
+      if(ring_space(ring, riov) > 1)
+      {
+        sqe->opcode = IORING_OP_READV;
+        sqe->addr = (unsigned long)riov;
+        sqe->len = 2;
+      }
+      else
+      {
+        sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->addr = (unsigned long)riov[0].iov_base;
+        sqe->len = riov[0].iov_len;
+      }
+      reading = 1;
+    }
+    /* too old input is dropped while no send refers to the queue */
+    if(maxage && !sending && !chunk.active && !regularfile
+    && !replay.active)
+      backlog_expire(ring, msec() - maxage);
+    /**  send data ***/
+    if(!sending && (cnt = queue_iov(outmode, ring, &chunk, siov)))
+    {
+      sqe = uring_sqe(&u, UR_SEND);
+      sqe->fd = sock;
+      if(cnt == 1 && fixed && outmode == NTRIP1)
+      {
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->addr = (unsigned long)siov[0].iov_base;
+        sqe->len = siov[0].iov_len;
+      }
+      else
+      {
+        msg.msg_iovlen = cnt;
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->addr = (unsigned long)&msg;
+        sqe->msg_flags = MSG_NOSIGNAL;
+      }
+      for(offered = 0; cnt--; )
+        offered += siov[cnt].iov_len;
+      sending = 1;
+    }
+    /* the timer lets the loop check the signal flags */
+    if(!timing)
+    {
+      sqe = uring_sqe(&u, UR_TIMER);
+      sqe->opcode = IORING_OP_TIMEOUT;
+      sqe->addr = (unsigned long)&ts;
+      sqe->len = 1;
+      timing = 1;
+    }
+    if(uring_enter(&u) < 0 && errno != EINTR)
+    {
+      perror("WARNING: io_uring_enter failed");
+      break;
+    }
+
+    head = *u.cqhead;
+    tail = __atomic_load_n(u.cqtail, __ATOMIC_ACQUIRE);
+    for(; head != tail; ++head)
+    {
+      struct io_uring_cqe *cqe = u.cqes + (head & *u.cqmask);
+
+      if(cqe->user_data == UR_READ)
+      {
+        reading = 0;
+        if(cqe->res > 0)
+        {
+          rtcm_input(ring, &backlog.framer, (size_t)cqe->res);
+          alarm(ALARMTIME);
+        }
+        else if(!cqe->res)
+        {
+          fprintf(stderr, "WARNING: no data received from input\n");
+          /* don't delay data which is still waiting for the caster */
+          if(queue_pending(ring, &chunk))
+            inputend = 1;
+          else
+            sleep(3);
+        }
+        else if(cqe->res != -EAGAIN && cqe->res != -EINTR)
+        {
+          errno = -cqe->res;
+          if(!sigint_received)
+            perror("WARNING: reading input failed");
+          backlog.open = 0;
+          stop = 1;
+        }
+      }
+      else if(cqe->user_data == UR_SEND)
+      {
+        sending = 0;
+        if(cqe->res >= 0)
+        {
+          ++metrics.writes;
+          if((size_t)cqe->res < offered)
+            ++metrics.short_writes;
+          queue_sent(outmode, ring, &chunk, (size_t)cqe->res);
+          if(cqe->res)
+            metrics_sent(msec());
+          if(!queue_pending(ring, &chunk))
+            inputend = 0;
+          if(!sent++)
+            reconnect_sec = 1;
+        }
+        else if(cqe->res == -EAGAIN)
+          ++metrics.eagain;
+        else if(cqe->res != -EINTR)
+        {
+          errno = -cqe->res;
+          perror("WARNING: could not send data to Destination caster");
+          stop = 1;
+        }
+      }
+      else if(cqe->user_data == UR_TIMER)
+        timing = 0;
+    }
+    __atomic_store_n(u.cqhead, head, __ATOMIC_RELEASE);
+  }
+
+  /* the kernel must be done with the ring before it may be freed */
+  while(reading || sending || timing)
+  {
+    unsigned head, tail;
+
+    if(!u.tosubmit)
+    {
+      if(reading) uring_cancel(&u, UR_READ);
+      if(sending) uring_cancel(&u, UR_SEND);
+      if(timing)  uring_cancel(&u, UR_TIMER);
+    }
+    if(uring_enter(&u) < 0 && errno != EINTR)
+      break;
+    head = *u.cqhead;
+    tail = __atomic_load_n(u.cqtail, __ATOMIC_ACQUIRE);
+    for(; head != tail; ++head)
+    {
+      __u64 op = u.cqes[head & *u.cqmask].user_data;
+      if(op == UR_READ) reading = 0;
+      else if(op == UR_SEND) sending = 0;
+      else if(op == UR_TIMER) timing = 0;
+    }
+    __atomic_store_n(u.cqhead, head, __ATOMIC_RELEASE);
+  }
+  /* no input for ALARMTIME seconds, though there was room to read */
+  if(sigalarm_received && ring_room(ring) >= BUFSZ)
+    backlog.open = 0;
+  fcntl(fd, F_SETFL, flags);
+  uring_free(&u);
+  rtcm_status(&backlog.framer);
+  lat_status(ring->lat, 0);
+  if(maxage)
+    fprintf(stderr, "%llu bytes older than %d ms dropped\n", metrics.expired,
+    maxage);
+  return 0;
+} /* transfer_uring */
+#endif /* IO_URING */
+
+
+/* payload went to the caster at now (msec()), this ends an output gap */
+static void metrics_sent(long long now)
+{
+  if(metrics.gapopen && metrics.lastoutput)
+  {
+    metrics.gap = now - metrics.lastoutput;
+    if(metrics.gap > metrics.maxgap)
+      metrics.maxgap = metrics.gap;
+    fprintf(stderr, "output resumed after a gap of %.3f s\n",
+    metrics.gap/1000.0);
+  }
+  metrics.gapopen = 0;
+  metrics.lastoutput = now;
+} /* metrics_sent */
+
+
+#ifndef WINDOWSVERSION
+/********************************************************************
+ * metrics endpoint                                                 *
+ *                                                                  *
+ * With "-S [Address:]Port" a thread of its own answers HTTP GET    *
+ * requests with the counters in Prometheus text format. The data   *
+ * path only bumps plain counters, it never waits for the endpoint, *
+ * and the endpoint reads them without locking, so a value may be  *
+ * a moment old.                                                    *
+*********************************************************************/
+#define METRICSZ 4096
+
+/* appends to the response, which is cut at the end of the buffer */
+static void metrics_add(char *buf, size_t *len, const char *fmt, ...)
+{
+  va_list ap;
+  int     n;
+
+  if(*len >= METRICSZ)
+    return;
+  va_start(ap, fmt);
+  n = vsnprintf(buf + *len, METRICSZ - *len, fmt, ap);
+  va_end(ap);
+  if(n > 0)
+    *len += (size_t)n;
+} /* metrics_add */
+
+static void metrics_counter(char *buf, size_t *len, const char *name,
+const char *help, unsigned long long value)
+{
+  metrics_add(buf, len, "# HELP ntripserver_%s %s\n"
+  "# TYPE ntripserver_%s counter\nntripserver_%s %llu\n",
+  name, help, name, name, value);
+} /* metrics_counter */
+
+static void metrics_gauge(char *buf, size_t *len, const char *name,
+const char *help, double value)
+{
+  metrics_add(buf, len, "# HELP ntripserver_%s %s\n"
+  "# TYPE ntripserver_%s gauge\nntripserver_%s %g\n",
+  name, help, name, name, value);
+} /* metrics_gauge */
+
+/* the metrics as Prometheus text, returns the length */
+static size_t metrics_text(char *buf)
+{
+  static const char *modes[] = { "http", "rtsp", "ntrip1", "udp" };
+  size_t             len = 0;
+  long long          last = metrics.lastinput;
+  int                i;
+
+  metrics_counter(buf, &len, "input_bytes_total",
+  "Bytes read from the input.", metrics.bytes_in);
+  metrics_counter(buf, &len, "output_bytes_total",
+  "Payload bytes taken by the caster socket.", metrics.bytes_out);
+  metrics_add(buf, &len, "# HELP ntripserver_rtcm_frames_total RTCM 3 frames"
+  " of the input (-r).\n# TYPE ntripserver_rtcm_frames_total counter\n"
+  "ntripserver_rtcm_frames_total{result=\"forwarded\"} %llu\n"
+  "ntripserver_rtcm_frames_total{result=\"filtered\"} %llu\n"
+  "ntripserver_rtcm_frames_total{result=\"bad\"} %llu\n",
+  metrics.frames_good - metrics.frames_filtered, metrics.frames_filtered,
+  metrics.frames_bad);
+  metrics_counter(buf, &len, "output_writes_total",
+  "Sends, RTP packets and splices to the caster.", metrics.writes);
+  metrics_counter(buf, &len, "output_short_writes_total",
+  "Sends the caster took only in part.", metrics.short_writes);
+  metrics_counter(buf, &len, "output_eagain_total",
+  "Sends the caster took nothing of.", metrics.eagain);
+  metrics_gauge(buf, &len, "caster_rtt_seconds",
+  "Smoothed round trip time of the caster connection (TCP_INFO).",
+  metrics.rtt/1e6);
+  metrics_gauge(buf, &len, "caster_rtt_variance_seconds",
+  "Round trip time variance of the caster connection.",
+  metrics.rttvar/1e6);
+  metrics_counter(buf, &len, "caster_retransmits_total",
+  "TCP segments retransmitted to the caster.", metrics.retransmits);
+  metrics_gauge(buf, &len, "caster_unacked_bytes",
+  "Bytes sent to the caster but not acknowledged yet.",
+  (double)metrics.unacked);
+  metrics_gauge(buf, &len, "caster_unsent_bytes",
+  "Bytes in the send queue of the kernel, not sent yet.",
+  (double)metrics.unsent);
+  metrics_counter(buf, &len, "expired_bytes_total",
+  "Input bytes older than -w, dropped unsent while the caster lagged.",
+  metrics.expired);
+  metrics_counter(buf, &len, "reconnects_total",
+  "Reconnects after a failed or ended transfer.", metrics.reconnects);
+  metrics_counter(buf, &len, "backlog_dropped_bytes_total",
+  "Input bytes kept while reconnecting, dropped as too old (-K) or for "
+  "room.", metrics.backlog_dropped);
+  metrics_gauge(buf, &len, "reconnect_delay_seconds",
+  "Current reconnect backoff.", reconnect_sec);
+  metrics_counter(buf, &len, "failovers_total",
+  "Switches to the hot standby caster connection (-G).", metrics.failovers);
+  metrics_gauge(buf, &len, "standby_ready",
+  "1 while the standby caster connection is ready.", standby.ready);
+  metrics_gauge(buf, &len, "output_gap_seconds",
+  "Time without output around the last reconnect or switch.",
+  metrics.gap/1000.0);
+  metrics_gauge(buf, &len, "output_gap_max_seconds",
+  "Longest time without output around a reconnect or switch.",
+  metrics.maxgap/1000.0);
+  metrics_gauge(buf, &len, "connect_ttfb_seconds",
+  "Time from the last caster connect to the first byte of its reply.",
+  metrics.ttfb/1000.0);
+  metrics_add(buf, &len, "# HELP ntripserver_fastopen_requests_total Upload"
+  " requests with TCP Fast Open (-o).\n"
+  "# TYPE ntripserver_fastopen_requests_total counter\n"
+  "ntripserver_fastopen_requests_total{sent=\"syn\"} %lu\n"
+  "ntripserver_fastopen_requests_total{sent=\"handshake\"} %lu\n",
+  metrics.fastopen_syn, metrics.fastopen_handshake);
+  metrics_add(buf, &len, "# HELP ntripserver_output_mode Output mode of the"
+  " last transfer, after fallback.\n# TYPE ntripserver_output_mode gauge\n");
+  for(i = 0; i < 4; ++i)
+    metrics_add(buf, &len, "ntripserver_output_mode{mode=\"%s\"} %d\n",
+    modes[i], metrics.outmode == i+1);
+  metrics_gauge(buf, &len, "connected",
+  "1 while data is transferred to the caster.", metrics.connected);
+  metrics_gauge(buf, &len, "input_idle_seconds",
+  "Time since the last input.", last ? (msec() - last)/1000.0 : -1);
+  metrics_gauge(buf, &len, "queue_bytes",
+  "Bytes waiting in the output queue.", (double)metrics.queued);
+  metrics_gauge(buf, &len, "queue_size_bytes",
+  "Size of the output queue.", (double)metrics.queuesize);
+  metrics_add(buf, &len, "# HELP ntripserver_latency_seconds Time from input"
+  " to the caster socket, per byte.\n"
+  "# TYPE ntripserver_latency_seconds summary\n"
+  "ntripserver_latency_seconds{quantile=\"0.5\"} %g\n"
+  "ntripserver_latency_seconds{quantile=\"0.99\"} %g\n"
+  "ntripserver_latency_seconds{quantile=\"0.999\"} %g\n"
+  "ntripserver_latency_seconds_sum %g\n"
+  "ntripserver_latency_seconds_count %llu\n",
+  lat_quantile(&latency, 0.5)/1000, lat_quantile(&latency, 0.99)/1000,
+  lat_quantile(&latency, 0.999)/1000, latency.sum, latency.total);
+  return len < METRICSZ ? len : METRICSZ-1;
+} /* metrics_text */
+
+static void *metrics_thread(void *arg)
+{
+  int            s = (int)(long)arg, c, n, len;
+  char           req[1024], head[128];
+  static char    body[METRICSZ];
+  struct timeval tv = {2, 0};
+  sigset_t       set;
+
+  /* signals are handled by the main thread */
+  sigfillset(&set);
+  pthread_sigmask(SIG_BLOCK, &set, 0);
+  for(;;)
+  {
+    if((c = accept(s, 0, 0)) < 0)
+    {
+      if(errno == EINTR || errno == ECONNABORTED)
+        continue;
+      perror("WARNING: metrics endpoint accept failed");
+      break;
+    }
+    /* a client which doesn't talk only delays the next scrape */
+    setsockopt(c, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(c, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    for(len = 0; len < (int)sizeof(req)-1; )
+    {
+      if((n = recv(c, req+len, sizeof(req)-1-len, 0)) <= 0)
+        break;
+      len += n;
+      req[len] = 0;
+      if(strstr(req, "\r\n\r\n"))
+        break;
+    }
+    if(len > 0 && !strncmp(req, "GET ", 4))
+    {
+      size_t blen = metrics_text(body);
+      n = snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\n"
+      "Content-Type: text/plain; version=0.0.4\r\n"
+      "Content-Length: %lu\r\nConnection: close\r\n\r\n",
+      (unsigned long)blen);
+      if(send(c, head, n, MSG_NOSIGNAL) == n)
+        send(c, body, blen, MSG_NOSIGNAL);
+    }
+    else if(len > 0)
+    {
+      static const char nak[] = "HTTP/1.0 405 Method Not Allowed\r\n\r\n";
+      send(c, nak, sizeof(nak)-1, MSG_NOSIGNAL);
+    }
+    close(c);
+  }
+  close(s);
+  return 0;
+} /* metrics_thread */
+
+/* listen on [Address:]Port, the address defaults to 127.0.0.1 */
+static int metrics_start(const char *addr)
+{
+  struct sockaddr_in sa;
+  const char        *colon = strrchr(addr, ':');
+  char               host[64];
+  pthread_t          thread;
+  int                s, on = 1;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(atoi(colon ? colon+1 : addr));
+  if(colon && (size_t)(colon-addr) < sizeof(host))
+  {
+    memcpy(host, addr, colon-addr);
+    host[colon-addr] = 0;
+  }
+  else
+    strcpy(host, "127.0.0.1");
+  if(!sa.sin_port || !inet_aton(host, &sa.sin_addr))
+  {
+    fprintf(stderr, "ERROR: invalid metrics address <%s>\n", addr);
+    return 0;
+  }
+  if((s = socket(AF_INET, SOCK_STREAM, 0)) < 0
+  || setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0
+  || bind(s, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(s, 4) < 0)
+  {
+    perror("ERROR: can't listen for metrics");
+    if(s >= 0)
+      close(s);
+    return 0;
+  }
+  if(pthread_create(&thread, 0, metrics_thread, (void *)(long)s))
+  {
+    fprintf(stderr, "ERROR: can't start metrics thread\n");
+    close(s);
+    return 0;
+  }
+  pthread_detach(thread);
+  fprintf(stderr, "metrics on http://%s:%d/metrics\n", host,
+  ntohs(sa.sin_port));
+  return 1;
+} /* metrics_start */
+#endif /* WINDOWSVERSION */
+
+
+#ifdef HAVE_EPOLL
+/********************************************************************
+ * daemon mode                                                      *
+ *                                                                  *
+ * Runs any number of input -> mountpoint pipelines described in a  *
+ * config file from one non-blocking epoll loop in one thread. All  *
+ * state the single stream mode keeps in globals is per stream here.*
+ *                                                                  *
+ * A stream may upload to several destination casters. The input is *
+ * read once into the ring of the stream, each destination sends    *
+ * from there with a tail, chunk state and reconnect state of its   *
+ * own. The ring is only freed behind the slowest destination; one  *
+ * which lags by the whole ring is cut, so it never stalls the rest.*
+ * The input is framed once per stream, a destination with an RTCM  *
+ * 3 message filter of its own decides on each frame when it gets   *
+ * to it and skips the unwanted ones, so every destination can      *
+ * forward a different selection of the same stream.                *
+*********************************************************************/
+#define DAEMON_QUEUESZ      4096
+#define DAEMON_CONNECTTIME  10
+#define DAEMON_CONNECTDELAY 1   /* s until the next address joins */
+#define DAEMON_MAXEVENTS    64
+
+enum DSTATE { DS_IDLE, DS_CONNECTING, DS_HANDSHAKE, DS_RUNNING, DS_STOPPED };
+enum EVKIND { EV_INPUT = 1, EV_OUTPUT };
+
+struct daemon_stream;
+
+struct daemon_input
+{
+  int                    evkind;       /* EV_INPUT, must be first */
+  struct daemon_stream * stream;
+  enum MODE              mode;
+  const char *           device;
+  int                    baud;
+  const char *           file;
+  const char *           host;
+  unsigned int           port;
+  int                    bindmode;
+  struct resolve *       resolve;      /* the host, looked up in the background */
+  int                    addrno;       /* of the host, to connect next */
+  int                    tried;        /* addresses which failed in a row */
+  const char *           initfile;
+  char *                 init;         /* see daemon_initsend() */
+  size_t                 initlen;
+  size_t                 initsent;
+  const char *           sourcemount;
+  const char *           sourceuser;
+  const char *           sourcepass;
+  int                    fd;
+  enum DSTATE            state;
+  time_t                 timer;        /* reconnect or timeout deadline */
+  time_t                 lastdata;
+  int                    reconnect_sec;
+  int                    events;       /* currently registered epoll events */
+  char                   reply[128];
+  int                    replylen;
+};
+
+struct daemon_output
+{
+  int                    evkind;       /* EV_OUTPUT, must be first */
+  struct daemon_stream * stream;
+  const char *           name;         /* "stream" or "stream/destination" */
+  int                    outmode;
+  const char *           host;
+  unsigned int           port;
+  struct resolve *       resolve;      /* the host, looked up in the background */
+  int                    addrno;       /* of the host, to connect next */
+  int                    tried;        /* addresses which failed in a row */
+  int                    fastopen;     /* the request goes with the SYN */
+  int                    deadtime;     /* see caster_sockopts() */
+  int                    nagle;
+  int                    maxage;       /* ms, see backlog_expire() */
+  const char *           mountpoint;
+  const char *           user;
+  const char *           password;
+  const char *           ntrip_str;
+  char                   authorization[SZ];
+  int                    fd;
+  enum DSTATE            state;
+  time_t                 timer;
+  int                    reconnect_sec;
+  int                    events;       /* currently registered epoll events */
+  struct ringbuf         queue;        /* own tail on the ring of the stream */
+  struct chunkstate      chunk;
+  struct rtcmfilter *    filter;       /* own message selection, if any */
+  size_t                 pass;         /* frames decided on up to here */
+  size_t                 skip;         /* unwanted frame at pass */
+  unsigned long          bytes_out;
+  unsigned long          bytes_dropped; /* cut while the caster lagged */
+  unsigned long          bytes_expired; /* older than maxage */
+  unsigned long          filtered;     /* frames */
+  unsigned long          filteredbytes;
+  struct latency         latency;
+  char                   reply[256];
+  int                    replylen;
+};
+
+struct daemon_stream
+{
+  const char *           name;
+  int                    reconnect_max;
+  size_t                 queuesize;
+  struct daemon_input    in;
+  enum RTCMMODE          rtcmmode;
+  struct rtcmframer      framer;
+  struct ringbuf         ring;         /* input, sent by all destinations */
+  struct daemon_output * out;
+  int                    nout;
+  unsigned long          bytes_in;
+  unsigned long          bytes_dropped; /* no destination was running */
+};
+
+static int daemon_epfd = -1;
+
+static void daemon_input_fail(struct daemon_input *in, int fatal);
+static void daemon_output_fail(struct daemon_output *out, int fatal);
+
+/* register, change or remove (events < 0) the epoll events of a fd */
+static void daemon_watch(int fd, int *current, int events, void *ptr)
+{
+  struct epoll_event ev;
+
+  if(events == *current) return;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events > 0 ? events : 0;
+  ev.data.ptr = ptr;
+  if(events < 0)
+    epoll_ctl(daemon_epfd, EPOLL_CTL_DEL, fd, &ev);
+  else if(*current < 0)
+    epoll_ctl(daemon_epfd, EPOLL_CTL_ADD, fd, &ev);
+  else
+    epoll_ctl(daemon_epfd, EPOLL_CTL_MOD, fd, &ev);
+  *current = events;
+} /* daemon_watch */
+
+static int daemon_nonblock(int fd)
+{
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+} /* daemon_nonblock */
+
+/* start a non-blocking connect, returns the socket, -1 on errors, -2
+   while the host is still being looked up, the lookup never blocks the
+   other streams, and -3 if the address failed at once */
+static int daemon_connect(struct resolve **r, int *addrno, const char *host,
+unsigned int port, int type, int bindmode, int tfo, int *inprogress)
+{
+  struct hostaddrs addrs;
+  int              order[MAXADDRS], fd, n;
+
+  *inprogress = 0;
+  memset(&addrs, 0, sizeof(addrs));
+  if(bindmode)
+  {
+    struct sockaddr_in *a = (struct sockaddr_in *)&addrs.addr[0];
+    a->sin_family = AF_INET;
+    a->sin_port = htons(port);
+    addrs.len[0] = sizeof(*a);
+  }
+  else
+  {
+    if(!*r)
+    {
+      if(!(*r = malloc(sizeof(**r))))
+        return -1;
+      resolve_init(*r, host, port);
+    }
+    if((n = resolve_get(*r, &addrs, 0)) <= 0)
+      return n ? -2 : -1;
+    /* the addresses are taken in turn, see daemon_nextaddr() */
+    resolve_order(&addrs, order);
+    n = order[*addrno % n];
+    addrs.addr[0] = addrs.addr[n];
+    addrs.len[0] = addrs.len[n];
+  }
+  if((fd = socket(addrs.addr[0].ss_family, type, 0)) < 0)
+  {
+    perror("WARNING: socket");
+    return -1;
+  }
+  daemon_nonblock(fd);
+  if(tfo) /* a deferred connect is writable at once */
+    fastopen_set(fd);
+  if(bindmode)
+  {
+    if(bind(fd, (struct sockaddr *)&addrs.addr[0], addrs.len[0]) < 0)
+    {
+      fprintf(stderr, "WARNING: can't bind input to port %d\n", port);
+      close(fd);
+      return -1;
+    }
+  }
+  else if(connect(fd, (struct sockaddr *)&addrs.addr[0], addrs.len[0]) < 0)
+  {
+    if(errno != EINPROGRESS)
+    {
+      fprintf(stderr, "WARNING: can't connect to %s at port %d\n",
+      addr_str(&addrs.addr[0], addrs.len[0]), port);
+      close(fd);
+      return -3;
+    }
+    *inprogress = 1;
+  }
+  return fd;
+} /* daemon_connect */
+
+static int daemon_addrcount(struct resolve *r)
+{
+  int count = 0;
+
+  if(r)
+  {
+    RESOLVE_LOCK(r);
+    count = r->addrs.count;
+    RESOLVE_UNLOCK(r);
+  }
+  return count;
+} /* daemon_addrcount */
+
+/* a failed connect goes on with the next address of the host at once,
+   returns 0 when all of them failed in a row and the backoff is due */
+static int daemon_nextaddr(struct resolve *r, int *addrno, int *tried)
+{
+  ++*addrno;
+  if(++*tried < daemon_addrcount(r))
+    return 1;
+  *tried = 0;
+  return 0;
+} /* daemon_nextaddr */
+
+/* seconds for a connect, short while other addresses are left to try; the
+   sweep runs once a second, so one more keeps it from ending at once */
+static int daemon_connecttime(struct resolve *r, int tried)
+{
+  return tried+1 < daemon_addrcount(r) ? DAEMON_CONNECTDELAY+1
+  : DAEMON_CONNECTTIME;
+} /* daemon_connecttime */
+
+/* read the init file for daemon_initsend(), returns 0 on success and
+   -2 if the file can't be read */
+static int daemon_initfile(struct daemon_input *in)
+{
+  FILE *fh;
+  char *p;
+  int   res = 0;
+
+  free(in->init);
+  in->init = 0;
+  in->initlen = in->initsent = 0;
+  if(!(fh = fopen(in->initfile, "r")))
+  {
+    fprintf(stderr, "ERROR: can't read init file <%s>\n", in->initfile);
+    return -2;
+  }
+  while(!res && !feof(fh))
+  {
+    if(!(p = realloc(in->init, in->initlen + 1024)))
+    {
+      fprintf(stderr, "ERROR: out of memory\n");
+      res = -2;
+      break;
+    }
+    in->init = p;
+    in->initlen += fread(in->init + in->initlen, 1, 1024, fh);
+    if(ferror(fh))
+    {
+      perror("ERROR: reading init file");
+      res = -2;
+    }
+  }
+  fclose(fh);
+  return res;
+} /* daemon_initfile */
+
+/* send as much of the init file as the input takes without blocking, the
+   rest goes out on EPOLLOUT; returns -1 on write errors */
+static int daemon_initsend(struct daemon_input *in)
+{
+  int n;
+
+  while(in->initsent < in->initlen)
+  {
+    if((n = write(in->fd, in->init + in->initsent,
+    in->initlen - in->initsent)) < 0)
+    {
+      if(errno == EINTR) continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+      perror("WARNING: sending init file");
+      return -1;
+    }
+    in->initsent += n;
+  }
+  if(in->initsent == in->initlen)
+  {
+    free(in->init);
+    in->init = 0;
+    in->initlen = in->initsent = 0;
+  }
+  return 0;
+} /* daemon_initsend */
+
+/* input connection is established */
+static void daemon_input_ready(struct daemon_input *in)
+{
+  struct daemon_stream *s = in->stream;
+
+  in->tried = 0; /* connected */
+  if(in->initfile && in->mode != SERIAL && in->mode != CASTER)
+  {
+    int r = daemon_initfile(in);
+    if(!r)
+      r = daemon_initsend(in);
+    if(r)
+    {
+      daemon_input_fail(in, r == -2);
+      return;
+    }
+  }
+  if(in->mode == CASTER)
+  {
+    char buf[BUFSZ];
+    int  n;
+    char auth[SZ*2] = "";
+
+    if(in->sourceuser && in->sourcepass)
+    {
+      strcpy(auth, "Authorization: Basic ");
+      if(encode(auth+21, sizeof(auth)-21-2, in->sourceuser, in->sourcepass)
+      > (int)sizeof(auth)-21-3)
+      {
+        fprintf(stderr, "%s: ERROR: Source caster user ID and/or password "
+        "too long\n", s->name);
+        daemon_input_fail(in, 1);
+        return;
+      }
+      strcat(auth, "\r\n");
+    }
+    n = snprintf(buf, sizeof(buf),
+      "GET %s/%s HTTP/1.0\r\n"
+      "User-Agent: %s/%s\r\n"
+      "Connection: close\r\n"
+      "%s"
+      "\r\n", "", in->sourcemount, AGENTSTRING, revisionstr, auth);
+    if(n < 0 || n >= (int)sizeof(buf)
+    || send(in->fd, buf, (size_t)n, MSG_NOSIGNAL) != n)
+    {
+      fprintf(stderr, "%s: WARNING: could not send Source caster request\n",
+      s->name);
+      daemon_input_fail(in, 0);
+      return;
+    }
+    in->replylen = 0;
+    in->state = DS_HANDSHAKE;
+    in->timer = time(0) + DAEMON_CONNECTTIME;
+    daemon_watch(in->fd, &in->events, EPOLLIN, in);
+    return;
+  }
+  in->state = DS_RUNNING;
+  in->lastdata = time(0);
+  daemon_watch(in->fd, &in->events, in->init ? EPOLLIN|EPOLLOUT : EPOLLIN, in);
+} /* daemon_input_ready */
+
+static void daemon_input_start(struct daemon_input *in)
+{
+  struct daemon_stream *s = in->stream;
+  int                   inprogress = 0;
+
+  in->events = -1;
+  switch(in->mode)
+  {
+  case SERIAL:
+    if((in->fd = openserial(in->device, 1, in->baud)) < 0)
+    {
+      daemon_input_fail(in, 0);
+      return;
+    }
+    daemon_nonblock(in->fd);
+    fprintf(stderr, "%s: serial input: device = %s, speed = %d\n", s->name,
+    in->device, in->baud);
+    if(in->initfile)
+    {
+      int r = daemon_initfile(in);
+      if(!r)
+        r = daemon_initsend(in);
+      if(r)
+      {
+        daemon_input_fail(in, r == -2);
+        return;
+      }
+    }
+    break;
+  case INFILE:
+    {
+      struct stat st;
+      if((in->fd = open(in->file, O_RDONLY | O_NONBLOCK)) < 0)
+      {
+        perror("ERROR: opening input file");
+        daemon_input_fail(in, 0);
+        return;
+      }
+      if(!fstat(in->fd, &st) && S_ISREG(st.st_mode))
+      {
+        /* epoll can't wait for regular files */
+        fprintf(stderr, "%s: ERROR: input file <%s> must be a fifo or device "
+        "in daemon mode\n", s->name, in->file);
+        daemon_input_fail(in, 1);
+        return;
+      }
+      fprintf(stderr, "%s: file input: file = %s\n", s->name, in->file);
+    }
+    break;
+  default:
+    if((in->fd = daemon_connect(&in->resolve, &in->addrno, in->host, in->port,
+    in->mode == UDPSOCKET ? SOCK_DGRAM : SOCK_STREAM, in->bindmode, 0,
+    &inprogress)) < 0)
+    {
+      if(in->fd == -2)
+        in->timer = time(0) + 1; /* look again on the next sweep */
+      else
+      {
+        if(in->fd == -3) /* like a connect which failed later */
+          in->state = DS_CONNECTING;
+        daemon_input_fail(in, 0);
+      }
+      in->fd = -1;
+      return;
+    }
+    fprintf(stderr, "%s: %s input: host = %s, port = %d%s\n", s->name,
+    in->mode == CASTER ? "caster" : in->mode == TCPSOCKET ? "tcp socket"
+    : "udp socket", in->host, in->port, in->bindmode ? ", binding mode" : "");
+    if(inprogress)
+    {
+      in->state = DS_CONNECTING;
+      in->timer = time(0) + daemon_connecttime(in->resolve, in->tried);
+      daemon_watch(in->fd, &in->events, EPOLLOUT, in);
+      return;
+    }
+    daemon_input_ready(in);
+    return;
+  }
+  in->state = DS_RUNNING;
+  in->lastdata = time(0);
+  daemon_watch(in->fd, &in->events, in->init ? EPOLLIN|EPOLLOUT : EPOLLIN, in);
+} /* daemon_input_start */
+
+static void daemon_close(int *fd)
+{
+  if(*fd >= 0)
+  {
+    close(*fd); /* also removes it from the epoll set */
+    *fd = -1;
+  }
+} /* daemon_close */
+
+/* schedule a reconnect, returns 0 if none is wanted */
+static int daemon_backoff(struct daemon_stream *s, const char *name,
+int *rec_sec, time_t *timer, const char *what, int fatal)
+{
+  if(fatal || !s->reconnect_max || sigint_received)
+    return 0;
+  fprintf(stderr, "%s: %s reconnect in <%d> seconds\n", name, what,
+  *rec_sec);
+  *timer = time(0) + *rec_sec;
+  *rec_sec *= 2;
+  if(*rec_sec > s->reconnect_max) *rec_sec = s->reconnect_max;
+  return 1;
+} /* daemon_backoff */
+
+static void daemon_stop(struct daemon_stream *s)
+{
+  int i;
+
+  fprintf(stderr, "%s: stream stopped\n", s->name);
+  daemon_close(&s->in.fd);
+  s->in.state = DS_STOPPED;
+  for(i = 0; i < s->nout; ++i)
+  {
+    daemon_close(&s->out[i].fd);
+    s->out[i].state = DS_STOPPED;
+  }
+} /* daemon_stop */
+
+static void daemon_input_fail(struct daemon_input *in, int fatal)
+{
+  int connecting = in->state == DS_CONNECTING;
+
+  daemon_close(&in->fd);
+  free(in->init);
+  in->init = 0;
+  in->state = DS_IDLE;
+  if(connecting && !fatal && daemon_nextaddr(in->resolve, &in->addrno,
+  &in->tried))
+  {
+    in->timer = 0;
+    return;
+  }
+  if(!daemon_backoff(in->stream, in->stream->name, &in->reconnect_sec,
+  &in->timer, "input", fatal))
+    daemon_stop(in->stream);
+} /* daemon_input_fail */
+
+/* a destination which gives up stops alone, the stream with the last one */
+static void daemon_output_fail(struct daemon_output *out, int fatal)
+{
+  struct daemon_stream *s = out->stream;
+  int                   i, connecting = out->state == DS_CONNECTING;
+
+  daemon_close(&out->fd);
+  out->state = DS_IDLE;
+  out->events = -1;
+  if(connecting && !fatal && daemon_nextaddr(out->resolve, &out->addrno,
+  &out->tried))
+  {
+    out->timer = 0;
+    return;
+  }
+  if(daemon_backoff(s, out->name, &out->reconnect_sec, &out->timer,
+  "output", fatal))
+    return;
+  out->state = DS_STOPPED;
+  for(i = 0; i < s->nout && s->out[i].state == DS_STOPPED; ++i)
+    ;
+  if(i == s->nout)
+    daemon_stop(s);
+  else
+    fprintf(stderr, "%s: output stopped\n", out->name);
+} /* daemon_output_fail */
+
+/* the destination sends the input from now on */
+static void daemon_output_attach(struct daemon_output *out)
+{
+  out->queue = out->stream->ring;
+  out->queue.tail = out->queue.frame = out->queue.head;
+  out->queue.pending = 0;
+  out->queue.expire = out->maxage != 0;
+  out->pass = out->queue.head;
+  out->skip = 0;
+  lat_attach(&out->queue, &out->latency);
+  memset(&out->chunk, 0, sizeof(out->chunk));
+} /* daemon_output_attach */
+
+/* decide on the frames behind those the destination has already got, the
+   wanted ones are given to the sender, an unwanted one is skipped as soon
+   as everything before it is sent */
+static void daemon_output_filter(struct daemon_output *out)
+{
+  struct ringbuf *q = &out->queue, *r = &out->stream->ring;
+  long long       now = 0;
+  size_t          len;
+
+  for(;;)
+  {
+    if(out->skip)
+    {
+      if(q->tail != out->pass)
+        break;
+      ring_skip(q, out->skip);
+      out->pass += out->skip;
+      out->skip = 0;
+    }
+    if(out->pass == r->head)
+      break;
+    len = (((RING_BYTE(r, out->pass+1) & 3) << 8)
+    | RING_BYTE(r, out->pass+2)) + 6;
+    if(rtcm_filter(out->filter, r, out->pass, len, &now))
+      out->pass += len;
+    else
+    {
+      out->skip = len;
+      ++out->filtered;
+      out->filteredbytes += len;
+    }
+  }
+  q->head = out->pass;
+} /* daemon_output_filter */
+
+/* move the ring tail to the slowest running destination; one which holds
+   the room the next read needs is cut, returns the running destinations */
+static int daemon_room(struct daemon_stream *s, size_t need)
+{
+  struct ringbuf *r = &s->ring;
+  size_t          tail = r->head, used;
+  int             i, running = 0;
+
+  for(i = 0; i < s->nout; ++i)
+  {
+    struct daemon_output *out = s->out+i;
+
+    if(out->state != DS_RUNNING)
+      continue;
+    if((used = r->head - out->queue.tail) > r->size - need)
+    {
+      struct ringbuf *q = &out->queue;
+      size_t          n = used - (r->size - need), c;
+
+      /* the rest of a chunk is announced already and can't be cut */
+      if(out->chunk.active)
+      {
+        fprintf(stderr, "%s: WARNING: Destination caster can't keep up\n",
+        out->name);
+        daemon_output_fail(out, 0);
+        continue;
+      }
+      /* framed input is cut between frames */
+      if(s->rtcmmode != RTCM_NONE)
+      {
+        for(c = backlog_sync(q); c < n; )
+          c += (((RING_BYTE(r, q->tail+c+1) & 3) << 8)
+          | RING_BYTE(r, q->tail+c+2)) + 6;
+        n = c;
+      }
+      out->bytes_dropped += n;
+      ring_skip(q, n);
+      if(out->filter && (long)(q->tail - out->pass) > 0)
+      {
+        out->pass = q->head = q->tail;
+        out->skip = 0;
+      }
+    }
+    if((long)(out->queue.tail - tail) < 0)
+      tail = out->queue.tail;
+    ++running;
+  }
+  r->tail = tail;
+  return running;
+} /* daemon_room */
+
+static void daemon_output_start(struct daemon_output *out)
+{
+  int inprogress;
+
+  if((out->fd = daemon_connect(&out->resolve, &out->addrno, out->host,
+  out->port, SOCK_STREAM, 0, out->fastopen, &inprogress)) < 0)
+  {
+    if(out->fd == -2)
+      out->timer = time(0) + 1; /* look again on the next sweep */
+    else
+    {
+      if(out->fd == -3) /* like a connect which failed later */
+        out->state = DS_CONNECTING;
+      daemon_output_fail(out, 0);
+    }
+    out->fd = -1;
+    return;
+  }
+  caster_sockopts(out->fd, out->deadtime, out->nagle, out->maxage);
+  fprintf(stderr, "%s: caster output: host = %s, port = %d, mountpoint = %s"
+  ", mode = %s\n", out->name, out->host, out->port, out->mountpoint,
+  out->outmode == NTRIP1 ? "ntrip1" : "http");
+  out->events = -1;
+  out->state = DS_CONNECTING;
+  out->timer = time(0) + daemon_connecttime(out->resolve, out->tried);
+  daemon_watch(out->fd, &out->events, EPOLLOUT, out);
+} /* daemon_output_start */
+
+/* send queued data and wait for writability only while data is pending */
+static void daemon_output_flush(struct daemon_output *out)
+{
+  struct ringbuf *q = &out->queue;
+  size_t          e;
+  int             n;
+
+  if(out->filter)
+    daemon_output_filter(out);
+  /* a lagging caster gets no input older than maxage, the frames cut
+     need no filter decision any more */
+  if(out->maxage && !out->chunk.active
+  && (e = backlog_expire(q, msec() - out->maxage)))
+  {
+    out->bytes_expired += e;
+    if(out->filter && (long)(q->tail - out->pass) > 0)
+    {
+      out->pass = q->head = q->tail;
+      out->skip = 0;
+      daemon_output_filter(out);
+    }
+  }
+  if((n = send_queue(out->fd, out->outmode, q, &out->chunk)) < 0)
+  {
+    fprintf(stderr, "%s: WARNING: could not send data to Destination caster:"
+    " %s\n", out->name, strerror(errno));
+    daemon_output_fail(out, 0);
+    return;
+  }
+  if(n)
+  {
+    out->bytes_out += n;
+    out->reconnect_sec = 1;
+    if(out->filter)
+      daemon_output_filter(out);
+  }
+  daemon_watch(out->fd, &out->events, queue_pending(&out->queue, &out->chunk)
+  ? EPOLLIN|EPOLLOUT : EPOLLIN, out);
+} /* daemon_output_flush */
+
+static void daemon_output_event(struct daemon_output *out, int events)
+{
+  char buf[BUFSZ];
+  int  n;
+
+  if(out->state == DS_CONNECTING)
+  {
+    int       err = 0;
+    socklen_t l = sizeof(err);
+
+    if(getsockopt(out->fd, SOL_SOCKET, SO_ERROR, &err, &l) < 0 || err)
+    {
+      fprintf(stderr, "%s: WARNING: can't connect output to %s at port %d\n",
+      out->name, out->host, out->port);
+      daemon_output_fail(out, 0);
+      return;
+    }
+    out->tried = 0;
+    n = build_caster_request(buf, sizeof(buf), out->outmode, "",
+    out->mountpoint, out->host, out->authorization, out->password,
+    out->ntrip_str);
+    if(n < 0 || n >= (int)sizeof(buf))
+    {
+      fprintf(stderr, "%s: ERROR: Destination caster request to long\n",
+      out->name);
+      daemon_output_fail(out, 1);
+      return;
+    }
+    if(send(out->fd, buf, (size_t)n, MSG_NOSIGNAL) != n)
+    {
+      fprintf(stderr, "%s: WARNING: could not send full header to "
+      "Destination caster\n", out->name);
+      daemon_output_fail(out, 0);
+      return;
+    }
+    out->replylen = 0;
+    out->state = DS_HANDSHAKE;
+    daemon_watch(out->fd, &out->events, EPOLLIN, out);
+    return;
+  }
+
+  if(out->state == DS_HANDSHAKE)
+  {
+    char *a;
+
+    if((n = recv(out->fd, out->reply + out->replylen,
+    sizeof(out->reply) - 1 - out->replylen, 0)) <= 0)
+    {
+      if(n < 0 && errno == EAGAIN) return;
+      fprintf(stderr, "%s: WARNING: Destination caster closed connection\n",
+      out->name);
+      daemon_output_fail(out, 0);
+      return;
+    }
+    out->replylen += n;
+    out->reply[out->replylen] = 0;
+    if(!strstr(out->reply, out->outmode == HTTP ? "\r\n\r\n" : "\r\n")
+    && out->replylen < (int)sizeof(out->reply) - 1)
+      return;
+    if(strstr(out->reply, out->outmode == HTTP ? "HTTP/1.1 200 OK" : "OK"))
+    {
+      daemon_output_attach(out);
+      out->state = DS_RUNNING;
+      fprintf(stderr, "%s: transfering data ...\n", out->name);
+      return;
+    }
+    fprintf(stderr, "%s: ERROR: Destination caster's reply is not OK: ",
+    out->name);
+    for(a = out->reply; *a && *a != '\n' && *a != '\r'; ++a)
+      fprintf(stderr, "%c", isprint(*a) ? *a : '.');
+    fprintf(stderr, "\n");
+    if(out->outmode == HTTP && !strstr(out->reply,
+    "Ntrip-Version: Ntrip/2.0\r\n"))
+    {
+      fprintf(stderr, "%s: Ntrip Version 2.0 not implemented at Destination "
+      "caster <%s>, falls back to Ntrip Version 1.0\n", out->name, out->host);
+      daemon_close(&out->fd);
+      out->outmode = NTRIP1;
+      daemon_output_start(out);
+      return;
+    }
+    daemon_output_fail(out, strstr(out->reply, "ERROR - Bad Password")
+    || strstr(out->reply, "400 Bad Request")
+    || strstr(out->reply, "401 Unauthorized")
+    || strstr(out->reply, "501 Not Implemented"));
+    return;
+  }
+
+  /* DS_RUNNING */
+  if(events & (EPOLLIN|EPOLLERR|EPOLLHUP))
+  {
+    /* casters don't talk during upload, anything but data means the end */
+    n = recv(out->fd, buf, sizeof(buf), 0);
+    if(n == 0 || (n < 0 && errno != EAGAIN))
+    {
+      fprintf(stderr, "%s: WARNING: Destination caster closed connection\n",
+      out->name);
+      daemon_output_fail(out, 0);
+      return;
+    }
+  }
+  if(events & EPOLLOUT)
+    daemon_output_flush(out);
+} /* daemon_output_event */
+
+static void daemon_input_event(struct daemon_input *in, int events)
+{
+  struct daemon_stream *s = in->stream;
+  struct iovec          iov[2];
+  char                  scratch[BUFSZ];
+  size_t                need;
+  int                   cnt = 0, n, i;
+
+  if(in->state == DS_CONNECTING)
+  {
+    int       err = 0;
+    socklen_t l = sizeof(err);
+
+    if(getsockopt(in->fd, SOL_SOCKET, SO_ERROR, &err, &l) < 0 || err)
+    {
+      fprintf(stderr, "%s: WARNING: can't connect input to %s at port %d\n",
+      s->name, in->host, in->port);
+      daemon_input_fail(in, 0);
+      return;
+    }
+    daemon_input_ready(in);
+    return;
+  }
+
+  if(in->state == DS_HANDSHAKE)
+  {
+    if((n = recv(in->fd, in->reply + in->replylen,
+    sizeof(in->reply) - 1 - in->replylen, 0)) <= 0)
+    {
+      if(n < 0 && errno == EAGAIN) return;
+      daemon_input_fail(in, 0);
+      return;
+    }
+    in->replylen += n;
+    in->reply[in->replylen] = 0;
+    if(!strstr(in->reply, "\r\n") && in->replylen < (int)sizeof(in->reply)-1)
+      return;
+    if(!strstr(in->reply, "ICY 200 OK"))
+    {
+      char *a;
+      fprintf(stderr, "%s: ERROR: could not get requested data from Source "
+      "caster: ", s->name);
+      for(a = in->reply; *a && *a != '\n' && *a != '\r'; ++a)
+        fprintf(stderr, "%c", isprint(*a) ? *a : '.');
+      fprintf(stderr, "\n");
+      daemon_input_fail(in, !strstr(in->reply, "SOURCETABLE 200 OK"));
+      return;
+    }
+    in->state = DS_RUNNING;
+    in->lastdata = time(0);
+    return;
+  }
+
+  if(in->init && (events & EPOLLOUT))
+  {
+    if(daemon_initsend(in) < 0)
+    {
+      daemon_input_fail(in, 0);
+      return;
+    }
+    daemon_watch(in->fd, &in->events, in->init ? EPOLLIN|EPOLLOUT : EPOLLIN,
+    in);
+  }
+  if(!(events & (EPOLLIN|EPOLLERR|EPOLLHUP)))
+    return;
+
+  /* input keeps draining while no output is running, the bytes are
+     dropped and counted; a datagram needs room for a whole one */
+  need = in->mode == UDPSOCKET || s->ring.size >= 4*BUFSZ ? BUFSZ
+  : s->ring.size/4;
+  if(daemon_room(s, need))
+    cnt = ring_space(&s->ring, iov);
+  if(in->state == DS_STOPPED)
+    return;
+  if(!cnt)
+  {
+    iov[0].iov_base = scratch;
+    iov[0].iov_len = sizeof(scratch);
+  }
+  if((n = readv(in->fd, iov, cnt ? cnt : 1)) < 0)
+  {
+    if(errno == EAGAIN || errno == EINTR) return;
+    fprintf(stderr, "%s: WARNING: reading input failed: %s\n", s->name,
+    strerror(errno));
+    daemon_input_fail(in, 0);
+    return;
+  }
+  if(!n)
+  {
+    fprintf(stderr, "%s: WARNING: no data received from input\n", s->name);
+    daemon_input_fail(in, 0);
+    return;
+  }
+  in->lastdata = time(0);
+  in->reconnect_sec = 1;
+  s->bytes_in += n;
+  if(!cnt)
+  {
+    s->bytes_dropped += n;
+    return;
+  }
+  rtcm_input(&s->ring, &s->framer, (size_t)n);
+  for(i = 0; i < s->nout; ++i)
+  {
+    struct daemon_output *out = s->out+i;
+
+    if(out->state != DS_RUNNING)
+      continue;
+    /* marked at the head of the stream, a filtered destination gets to
+       see less, see daemon_output_filter() */
+    out->queue.head = s->ring.head;
+    lat_in(&out->queue);
+    daemon_output_flush(out);
+  }
+} /* daemon_input_event */
+
+/* reconnect and timeout handling, called once a second */
+static int daemon_sweep(struct daemon_stream *streams, int nstreams)
+{
+  time_t now = time(0);
+  int    i, j, active = 0;
+
+  for(i = 0; i < nstreams; ++i)
+  {
+    struct daemon_stream *s = streams+i;
+
+    if(s->in.state == DS_STOPPED)
+      continue;
+    ++active;
+    if(s->in.state == DS_IDLE && now >= s->in.timer)
+      daemon_input_start(&s->in);
+    else if((s->in.state == DS_CONNECTING || s->in.state == DS_HANDSHAKE)
+    && now >= s->in.timer)
+    {
+      fprintf(stderr, "%s: WARNING: input connection timed out\n", s->name);
+      daemon_input_fail(&s->in, 0);
+    }
+    else if(s->in.state == DS_RUNNING && now - s->in.lastdata >= ALARMTIME)
+    {
+      fprintf(stderr, "%s: ERROR: more than %d seconds no activity\n",
+      s->name, ALARMTIME);
+      daemon_input_fail(&s->in, 0);
+    }
+
+    for(j = 0; j < s->nout; ++j)
+    {
+      struct daemon_output *out = s->out+j;
+
+      if(out->state == DS_IDLE && now >= out->timer)
+        daemon_output_start(out);
+      else if((out->state == DS_CONNECTING || out->state == DS_HANDSHAKE)
+      && now >= out->timer)
+      {
+        fprintf(stderr, "%s: WARNING: output connection timed out\n",
+        out->name);
+        daemon_output_fail(out, 0);
+      }
+    }
+  }
+  return active;
+} /* daemon_sweep */
+
+
+/********************************************************************
+ * daemon mode config file                                          *
+ *                                                                  *
+ * One "key value" pair per line, '#' starts a comment. "stream     *
+ * <name>" begins a new pipeline, keys before the first stream are  *
+ * defaults for all streams. Keys are named after the placeholders  *
+ * of the command line options in the usage text.                   *
+*********************************************************************/
+/* a message filter key of a destination, the filter is allocated with the
+   first one */
+static int daemon_config_filter(struct daemon_output *out, int option,
+const char *value)
+{
+  if(!out->filter && !(out->filter = calloc(1, sizeof(*out->filter))))
+    return -1;
+  return rtcm_parsefilter(out->filter, option, value) ? 0 : -1;
+} /* daemon_config_filter */
+
+static int daemon_config_set(struct daemon_stream *s, const char *key,
+const char *value)
+{
+  struct daemon_output *out = s->out + s->nout-1; /* the last destination */
+
+  if(!strcmp(key, "inputmode"))
+  {
+    if(!(s->in.mode = parse_inputmode(value))) return -1;
+  }
+  else if(!strcmp(key, "device"))      s->in.device = value;
+  else if(!strcmp(key, "baudrate"))
+  {
+    if((s->in.baud = atoi(value)) <= 1) return -1;
+  }
+  else if(!strcmp(key, "file"))        s->in.file = value;
+  else if(!strcmp(key, "initfile"))    s->in.initfile = value;
+  else if(!strcmp(key, "serverhost"))  s->in.host = value;
+  else if(!strcmp(key, "serverport"))
+  {
+    s->in.port = atoi(value);
+    if(s->in.port <= 1 || s->in.port > 65535) return -1;
+  }
+  else if(!strcmp(key, "bind"))        s->in.bindmode = atoi(value);
+  else if(!strcmp(key, "sourcemount")) s->in.sourcemount = value;
+  else if(!strcmp(key, "sourceuser"))  s->in.sourceuser = value;
+  else if(!strcmp(key, "sourcepass"))  s->in.sourcepass = value;
+  else if(!strcmp(key, "outputmode"))
+  {
+    if(!(out->outmode = parse_outputmode(value))) return -1;
+  }
+  else if(!strcmp(key, "desthost"))    out->host = value;
+  else if(!strcmp(key, "destport"))
+  {
+    out->port = atoi(value);
+    if(out->port <= 1 || out->port > 65535) return -1;
+  }
+  else if(!strcmp(key, "destmount"))   out->mountpoint = value;
+  else if(!strcmp(key, "destuser"))    out->user = value;
+  else if(!strcmp(key, "destpass"))    out->password = value;
+  else if(!strcmp(key, "str"))         out->ntrip_str = value;
+  else if(!strcmp(key, "fastopen"))    out->fastopen = atoi(value);
+  else if(!strcmp(key, "deadtime"))
+  {
+    if((out->deadtime = atoi(value)) < 0) return -1;
+  }
+  else if(!strcmp(key, "nagle"))       out->nagle = atoi(value);
+  else if(!strcmp(key, "maxage"))
+  {
+    if((out->maxage = atoi(value)) < 0) return -1;
+  }
+  else if(!strcmp(key, "allowtypes"))  return daemon_config_filter(out, 'A',
+  value);
+  else if(!strcmp(key, "droptypes"))   return daemon_config_filter(out, 'X',
+  value);
+  else if(!strcmp(key, "throttle"))    return daemon_config_filter(out, 'L',
+  value);
+  else if(!strcmp(key, "decimate"))    return daemon_config_filter(out, 'Z',
+  value);
+  else if(!strcmp(key, "rtcmmode"))
+  {
+    if(!strcmp(value, "none"))       s->rtcmmode = RTCM_NONE;
+    else if(!strcmp(value, "check")) s->rtcmmode = RTCM_CHECK;
+    else if(!strcmp(value, "align")) s->rtcmmode = RTCM_ALIGN;
+    else return -1;
+  }
+  else if(!strcmp(key, "maxdelay"))
+  {
+    if((s->reconnect_max = atoi(value)) < 0) return -1;
+    if(s->reconnect_max && s->reconnect_max < 256) s->reconnect_max = 256;
+  }
+  else if(!strcmp(key, "queuesize"))
+  {
+    if((s->queuesize = atoi(value)) < BUFSZ) return -1;
+  }
+  else return -2;
+  return 0;
+} /* daemon_config_set */
+
+/* check a stream and fill in the defaults of the command line version */
+static int daemon_config_check(struct daemon_stream *s)
+{
+  struct daemon_input * in = &s->in;
+  int                   i;
+
+  if(in->mode == SISNET)
+  {
+    fprintf(stderr, "ERROR: %s: SISNeT input is not supported in daemon "
+    "mode\n", s->name);
+    return 0;
+  }
+  if(in->mode == CASTER)
+  {
+    if(!in->port) in->port = NTRIP_PORT;
+    if(!in->host) in->host = NTRIP_CASTER;
+    if(!in->sourcemount)
+    {
+      fprintf(stderr, "ERROR: %s: missing sourcemount\n", s->name);
+      return 0;
+    }
+  }
+  else if(in->mode == TCPSOCKET || in->mode == UDPSOCKET)
+  {
+    if(!in->port) in->port = SERV_TCP_PORT;
+    if(!in->host) in->host = SERV_HOST_ADDR;
+  }
+  for(i = 0; i < s->nout; ++i)
+  {
+    struct daemon_output *out = s->out+i;
+
+    if(!out->mountpoint)
+      out->mountpoint = s->name;
+    if(out->outmode != NTRIP1 && out->outmode != HTTP)
+    {
+      fprintf(stderr, "ERROR: %s: only ntrip1 and http output are supported "
+      "in daemon mode\n", out->name);
+      return 0;
+    }
+    if(!out->password[0])
+    {
+      fprintf(stderr, "WARNING: %s: Missing password argument for stream "
+      "upload - are you really sure?\n", out->name);
+    }
+    else if(encode(out->authorization, sizeof(out->authorization), out->user,
+    out->password) > (int)sizeof(out->authorization))
+    {
+      fprintf(stderr, "ERROR: %s: user ID and/or password too long\n",
+      out->name);
+      return 0;
+    }
+    out->evkind = EV_OUTPUT;
+    out->stream = s;
+    out->fd = -1;
+    out->events = -1;
+    out->reconnect_sec = 1;
+    /* the filter and maxage work on whole frames */
+    if((out->filter || out->maxage) && s->rtcmmode == RTCM_NONE)
+      s->rtcmmode = RTCM_CHECK;
+  }
+  /* room for an incomplete frame besides a full read */
+  if(s->rtcmmode != RTCM_NONE && s->queuesize < 4*BUFSZ)
+    s->queuesize = 4*BUFSZ;
+  if(!ring_init(&s->ring, s->queuesize))
+  {
+    fprintf(stderr, "ERROR: %s: out of memory\n", s->name);
+    return 0;
+  }
+  s->ring.framed = s->rtcmmode == RTCM_ALIGN;
+  rtcm_init(&s->framer, s->rtcmmode);
+  s->framer.filter = 0; /* the destinations filter */
+  in->evkind = EV_INPUT;
+  in->stream = s;
+  in->fd = -1;
+  in->reconnect_sec = 1;
+  return 1;
+} /* daemon_config_check */
+
+/* add a destination with the defaults, and a filter state of its own */
+static int daemon_config_output(struct daemon_stream *s,
+const struct daemon_output *def, const char *name)
+{
+  struct daemon_output *n;
+
+  if(!(n = realloc(s->out, (s->nout+1)*sizeof(*s->out))))
+    return 0;
+  s->out = n;
+  n += s->nout;
+  *n = *def;
+  n->name = name;
+  if(def->filter)
+  {
+    if(!(n->filter = malloc(sizeof(*n->filter))))
+      return 0;
+    *n->filter = *def->filter;
+  }
+  ++s->nout;
+  return 1;
+} /* daemon_config_output */
+
+/* returns the number of streams or 0 on error */
+static int daemon_config(const char *configfile, struct daemon_stream **streams)
+{
+  struct daemon_stream defaults, *s = &defaults;
+  struct daemon_output defout;
+  char                 line[BUFSZ];
+  FILE *               fh;
+  int                  nstreams = 0, lineno = 0, error = 0;
+
+  memset(&defaults, 0, sizeof(defaults));
+  memset(&defout, 0, sizeof(defout));
+  defaults.in.mode = INFILE;
+  defaults.in.device = ttyport;
+  defaults.in.baud = ttybaud;
+  defaults.in.file = filepath;
+  defaults.out = &defout;
+  defaults.nout = 1;
+  defout.outmode = NTRIP1;
+  defout.host = NTRIP_CASTER;
+  defout.port = NTRIP_PORT;
+  defout.user = "";
+  defout.password = "";
+  defout.ntrip_str = "";
+  defout.deadtime = deadtime;
+  defout.maxage = maxage;
+  defaults.queuesize = DAEMON_QUEUESZ;
+  *streams = 0;
+
+  if(!(fh = fopen(configfile, "r")))
+  {
+    fprintf(stderr, "ERROR: can't read config file <%s>\n", configfile);
+    return 0;
+  }
+  while(!error && fgets(line, sizeof(line), fh))
+  {
+    char *key, *value, *end;
+    int   r;
+
+    ++lineno;
+    if((end = strchr(line, '#'))) *end = 0;
+    for(key = line; isspace((unsigned char)*key); ++key)
+      ;
+    if(!*key) continue;
+    for(value = key; *value && !isspace((unsigned char)*value); ++value)
+      ;
+    if(*value) *(value++) = 0;
+    while(isspace((unsigned char)*value)) ++value;
+    for(end = value + strlen(value); end > value
+    && isspace((unsigned char)end[-1]); --end)
+      ;
+    *end = 0;
+    if(!*value)
+    {
+      fprintf(stderr, "ERROR: %s:%d: missing value for <%s>\n", configfile,
+      lineno, key);
+      error = 1;
+      break;
+    }
+    if(!(value = strdup(value)))
+    {
+      error = 1;
+      break;
+    }
+    if(!strcmp(key, "stream"))
+    {
+      struct daemon_stream *n;
+      if(!(n = realloc(*streams, (nstreams+1)*sizeof(**streams))))
+      {
+        error = 1;
+        break;
+      }
+      *streams = n;
+      s = n + nstreams++;
+      *s = defaults;
+      s->name = value;
+      s->out = 0;
+      s->nout = 0;
+      if(!daemon_config_output(s, &defout, value))
+      {
+        error = 1;
+        break;
+      }
+    }
+    else if(!strcmp(key, "destination"))
+    {
+      char *name;
+
+      /* another caster of the stream, with the destination defaults */
+      if(s == &defaults)
+      {
+        fprintf(stderr, "ERROR: %s:%d: destination outside of a stream\n",
+        configfile, lineno);
+        error = 1;
+        break;
+      }
+      if(!(name = malloc(strlen(s->name) + strlen(value) + 2)))
+      {
+        error = 1;
+        break;
+      }
+      sprintf(name, "%s/%s", s->name, value);
+      if(!daemon_config_output(s, &defout, name))
+      {
+        error = 1;
+        break;
+      }
+    }
+    else if((r = daemon_config_set(s, key, value)))
+    {
+      fprintf(stderr, "ERROR: %s:%d: %s <%s>\n", configfile, lineno,
+      r == -2 ? "unknown key" : "invalid value for", r == -2 ? key : value);
+      error = 1;
+    }
+  }
+  fclose(fh);
+  if(!error && !nstreams)
+  {
+    fprintf(stderr, "ERROR: no stream defined in config file <%s>\n",
+    configfile);
+    error = 1;
+  }
+  for(lineno = 0; !error && lineno < nstreams; ++lineno)
+  {
+    if(!daemon_config_check(*streams + lineno))
+      error = 1;
+  }
+  return error ? 0 : nstreams;
+} /* daemon_config */
+
+
+/********************************************************************
+ * daemon mode main loop                                            *
+*********************************************************************/
+static int daemon_main(const char *configfile)
+{
+  struct daemon_stream *streams;
+  struct epoll_event    events[DAEMON_MAXEVENTS];
+  int                   nstreams, i, j, n;
+  time_t                nextsweep = 0;
+
+  if(!(nstreams = daemon_config(configfile, &streams)))
+    exit(1);
+  /* inactivity is watched per stream */
+  alarm(0);
+#ifdef SIGPIPE
+  signal(SIGPIPE, SIG_IGN);
+#endif
+  if((daemon_epfd = epoll_create(nstreams*2+1)) < 0)
+  {
+    perror("ERROR: epoll_create");
+    exit(1);
+  }
+  fprintf(stderr, "daemon mode: %d streams from <%s>\n", nstreams, configfile);
+
+  while(!sigint_received)
+  {
+    if(sigusr1_received)
+    {
+      sigusr1_received = 0;
+      for(i = 0; i < nstreams; ++i)
+      {
+        for(j = 0; j < streams[i].nout; ++j)
+          lat_status(&streams[i].out[j].latency, streams[i].out[j].name);
+      }
+    }
+    if(time(0) >= nextsweep)
+    {
+      if(!daemon_sweep(streams, nstreams))
+        break;
+      nextsweep = time(0) + 1;
+    }
+    if((n = epoll_wait(daemon_epfd, events, DAEMON_MAXEVENTS, 1000)) < 0)
+    {
+      if(errno == EINTR) continue;
+      perror("ERROR: epoll_wait");
+      break;
+    }
+    for(i = 0; i < n; ++i)
+    {
+      if(*(int *)events[i].data.ptr == EV_INPUT)
+      {
+        struct daemon_input *in = events[i].data.ptr;
+        if(in->fd >= 0) daemon_input_event(in, events[i].events);
+      }
+      else
+      {
+        struct daemon_output *out = events[i].data.ptr;
+        if(out->fd >= 0) daemon_output_event(out, events[i].events);
+      }
+    }
+  }
+
+  for(i = 0; i < nstreams; ++i)
+  {
+    struct daemon_stream *s = streams+i;
+
+    fprintf(stderr, "%s: %lu bytes in, %lu bytes dropped\n", s->name,
+    s->bytes_in, s->bytes_dropped);
+    if(s->rtcmmode != RTCM_NONE)
+      fprintf(stderr, "%s: RTCM 3 frames: %lu good, %lu bad, %lu bytes "
+      "skipped\n", s->name, s->framer.good, s->framer.bad,
+      s->framer.skipped);
+    for(j = 0; j < s->nout; ++j)
+    {
+      struct daemon_output *out = s->out+j;
+
+      fprintf(stderr, "%s: %lu bytes out, %lu bytes dropped\n", out->name,
+      out->bytes_out, out->bytes_dropped);
+      if(out->maxage)
+        fprintf(stderr, "%s: %lu bytes older than %d ms dropped\n",
+        out->name, out->bytes_expired, out->maxage);
+      if(out->filter)
+        fprintf(stderr, "%s: RTCM 3 filter: %lu frames, %lu bytes dropped\n",
+        out->name, out->filtered, out->filteredbytes);
+      lat_status(&out->latency, out->name);
+      daemon_close(&out->fd);
+      free(out->filter);
+    }
+    daemon_close(&s->in.fd);
+    free(s->in.init);
+    ring_free(&s->ring);
+    free(s->out);
+  }
+  close(daemon_epfd);
+  free(streams);
+  return 0;
+} /* daemon_main */
+#endif /* HAVE_EPOLL */
@@ -0,0 +1,110 @@
+/*
+ * rtcmbench.c
+ *
+ * Microbenchmark of the RTCM 3 input framer of ntripserver (-r check).
+ * A buffer of valid RTCM 3 frames, optionally mixed with line noise, is
+ * fed through the input ring in reads of serial port size and the CPU
+ * time of the framing is compared to a 921600 baud receiver stream.
+ *
+ * Usage: rtcmbench [MegaBytes] [ReadSize] [NoisePercent]
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+/* the framer is used exactly as compiled into ntripserver */
+#define main ntripserver_main
+#include "ntripserver.c"
+#undef main
+
+#define BAUDRATE 921600
+
+/* appends one frame with a payload of len bytes, returns its size */
+static size_t bench_frame(unsigned char *buf, size_t len)
+{
+  struct ringbuf r;
+  unsigned long  crc;
+  size_t         i;
+
+  buf[0] = RTCM3_PREAMBLE;
+  buf[1] = len >> 8;
+  buf[2] = len;
+  for(i = 0; i < len; ++i)
+    buf[3+i] = rand();
+  /* rtcm_crc() works on a ring, so the buffer is described as one */
+  r.data = (char *)buf;
+  r.size = (size_t)1 << 30;
+  crc = rtcm_crc(&r, 0, len+3);
+  buf[len+3] = crc >> 16;
+  buf[len+4] = crc >> 8;
+  buf[len+5] = crc;
+  return len+6;
+} /* bench_frame */
+
+int main(int argc, char **argv)
+{
+  size_t            total = (argc > 1 ? atoi(argv[1]) : 256) * 1000000UL;
+  size_t            readsize = argc > 2 ? atoi(argv[2]) : 256;
+  int               noise = argc > 3 ? atoi(argv[3]) : 0;
+  size_t            size = 0, pos, n, out = 0;
+  unsigned char    *data;
+  struct ringbuf    ring;
+  struct rtcmframer framer;
+  struct iovec      iov[2];
+  clock_t           start;
+  double            sec;
+
+  if(!readsize || readsize > BUFSZ || !(data = malloc(total + RTCM3_MAXLEN)))
+  {
+    fprintf(stderr, "Usage: %s [MegaBytes] [ReadSize<=%d] [NoisePercent]\n",
+    argv[0], BUFSZ);
+    return 1;
+  }
+  /* builds the CRC table, too */
+  rtcm_init(&framer, RTCM_CHECK);
+  srand(1);
+  /* MSM7 observations of 4 systems, a station record and ephemerides */
+  while(size < total)
+  {
+    static const size_t lens[] = {430, 380, 290, 310, 20, 62, 137};
+    if(noise && rand() % 100 < noise)
+    {
+      for(n = rand() % 32 + 1; n--; )
+        data[size++] = rand();
+    }
+    size += bench_frame(data+size, lens[rand() % 7]);
+  }
+  if(!ring_init(&ring, QUEUESZ))
+    return 1;
+
+  start = clock();
+  for(pos = 0; pos < size; pos += n)
+  {
+    int cnt = ring_space(&ring, iov), i;
+    n = size-pos < readsize ? size-pos : readsize;
+    /* the copy stands for the read() into the ring */
+    for(i = 0, out = 0; i < cnt && out < n; ++i)
+    {
+      size_t c = iov[i].iov_len < n-out ? iov[i].iov_len : n-out;
+      memcpy(iov[i].iov_base, data+pos+out, c);
+      out += c;
+    }
+    rtcm_input(&ring, &framer, n);
+    ring_consume(&ring, ring_used(&ring));
+  }
+  sec = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  printf("%.1f MB in reads of %lu bytes, %d%% noisy frames\n", size/1e6,
+  (unsigned long)readsize, noise);
+  rtcm_status(&framer);
+  fflush(stderr);
+  printf("%.3f s CPU, %.2f ns/byte, %.0f MB/s\n", sec, sec*1e9/size,
+  size/sec/1e6);
+  printf("%d baud (%d bytes/s): %.4f%% of one CPU\n", BAUDRATE,
+  BAUDRATE/10, 100.0*sec/size*(BAUDRATE/10));
+  ring_free(&ring);
+  free(data);
+  return 0;
+} /* main */